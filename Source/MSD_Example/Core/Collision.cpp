@@ -0,0 +1,226 @@
+#include "Collision.h"
+#include "Solver.h"
+#include "MSDStats.h"
+
+// cells of the self collision grid per point at most, coarser cells beyond that
+#define COLLISION_CELLS_PER_POINT 8
+
+
+// Moves a point depth along n and stops its velocity into the surface, the
+// tangential part loses friction times what the normal part lost.
+static void push_out(FVector & pos, FVector & vel, const FVector & n, float depth, float friction)
+{
+    pos += n * depth;
+    
+    const float vn = FVector::DotProduct(vel, n);
+    if (vn < 0.0f)
+    {
+        const FVector vt = vel - n * vn;
+        const float vt_size = vt.Size();
+        vel = vt_size > 0.0f ? vt * FMath::Max(1.0f - friction * -vn / vt_size, 0.0f) : FVector(0, 0, 0);
+    }
+}
+
+// signed distance of p from the box surface and the direction out of it
+static float box_distance(const Collision_Box & box, const FVector & p, FVector & n)
+{
+    const FVector local = p - box.center;
+    FVector q;
+    FVector outside(0, 0, 0);
+    for (int32 axis = 0; axis < 3; ++axis)
+    {
+        q[axis] = FVector::DotProduct(local, box.axes[axis]);
+        outside[axis] = q[axis] - FMath::Clamp(q[axis], -box.extent[axis], box.extent[axis]);
+    }
+    
+    const float outside_size = outside.Size();
+    if (outside_size > 0.0f)
+    {
+        n = (box.axes[0] * outside.X + box.axes[1] * outside.Y + box.axes[2] * outside.Z) / outside_size;
+        return outside_size;
+    }
+    
+    // inside, out through the closest face
+    int32 face = 0;
+    float best = FMath::Abs(q.X) - box.extent.X;
+    for (int32 axis = 1; axis < 3; ++axis)
+    {
+        const float d = FMath::Abs(q[axis]) - box.extent[axis];
+        if (d > best)
+        {
+            best = d;
+            face = axis;
+        }
+    }
+    n = q[face] < 0.0f ? -box.axes[face] : box.axes[face];
+    return best;
+}
+
+// direction from center to p, up when p sits on the center
+static float round_distance(const FVector & p, const FVector & center, float radius, FVector & n)
+{
+    const FVector d = p - center;
+    const float size = d.Size();
+    n = size > 0.0f ? d / size : FVector(0, 0, 1);
+    return size - radius;
+}
+
+int32 collision_resolve_world(Particle_Store & points, const Collision_World & world, const Collision_Params & params, int32 begin, int32 end)
+{
+    const float thickness = params.thickness;
+    const float friction = params.friction;
+    FVector * pos = points.pos.GetData();
+    FVector * vel = points.vel.GetData();
+    int32 contacts = 0;
+    
+    solver_free_runs(points, begin, end, [&](int32 run_begin, int32 run_end)
+    {
+        for (int32 idx = run_begin; idx < run_end; ++idx)
+        {
+            // every shape once, later shapes see the point where earlier ones left it
+            for (const Collision_Plane & plane : world.planes)
+            {
+                const float s = FVector::DotProduct(plane.normal, pos[idx]) - plane.distance;
+                if (s < thickness)
+                {
+                    push_out(pos[idx], vel[idx], plane.normal, thickness - s, friction);
+                    ++contacts;
+                }
+            }
+            for (const Collision_Sphere & sphere : world.spheres)
+            {
+                FVector n;
+                const float s = round_distance(pos[idx], sphere.center, sphere.radius, n);
+                if (s < thickness)
+                {
+                    push_out(pos[idx], vel[idx], n, thickness - s, friction);
+                    ++contacts;
+                }
+            }
+            for (const Collision_Capsule & capsule : world.capsules)
+            {
+                const FVector axis = capsule.b - capsule.a;
+                const float axis_sq = axis.SizeSquared();
+                const float t = axis_sq > 0.0f ? FMath::Clamp(FVector::DotProduct(pos[idx] - capsule.a, axis) / axis_sq, 0.0f, 1.0f) : 0.0f;
+                
+                FVector n;
+                const float s = round_distance(pos[idx], capsule.a + axis * t, capsule.radius, n);
+                if (s < thickness)
+                {
+                    push_out(pos[idx], vel[idx], n, thickness - s, friction);
+                    ++contacts;
+                }
+            }
+            for (const Collision_Box & box : world.boxes)
+            {
+                FVector n;
+                const float s = box_distance(box, pos[idx], n);
+                if (s < thickness)
+                {
+                    push_out(pos[idx], vel[idx], n, thickness - s, friction);
+                    ++contacts;
+                }
+            }
+        }
+    });
+    return contacts;
+}
+
+// joined by a spring that has not torn
+static bool lattice_neighbours(const Particle_Store & points, int32 a, int32 b)
+{
+    const Lattice_Topology & topology = *points.topology;
+    for (int32 n = topology.neighbour_offsets[a]; n < topology.neighbour_offsets[a + 1]; ++n)
+    {
+        if (topology.neighbour_list[n] == b)
+        {
+            return !plastic_is_torn(points, topology.neighbour_spring[n]);
+        }
+    }
+    return false;
+}
+
+int32 collision_resolve_self(Particle_Store & points, const Collision_Params & params, bool multithreaded)
+{
+    const int32 count = points.Num();
+    const float diameter = params.thickness * 2.0f;
+    const Lattice_Topology & topology = *points.topology;
+    const Sleep_State & sleep = points.sleep;
+    const bool tracked = sleep.num_points == count;
+    const int32 chunk_points = tracked ? sleep.chunk_points : SOLVER_CHUNK_POINTS;
+    const int32 num_chunks = FMath::DivideAndRoundUp(count, chunk_points);
+    
+    // points of resting chunks and pinned points do not give way, whoever
+    // runs into them takes the whole correction
+    auto movable = [&](int32 idx)
+    {
+        return points.inv_mass[idx] > 0.0f && (!tracked || sleep.chunk_awake[idx / chunk_points]);
+    };
+    
+    TArray<int32> chunk_contacts;
+    chunk_contacts.SetNumZeroed(num_chunks);
+    points.collision_delta.SetNumUninitialized(count);
+    {
+        MSD_SCOPE_CYCLE(STAT_MSD_BroadPhase);
+        if (!dense_grid_build(points.collision_grid, points.pos, diameter, COLLISION_CELLS_PER_POINT))
+        {
+            // a diverged step, nothing sensible to push apart
+            return 0;
+        }
+        
+        solver_parallel_chunks(count, chunk_points, multithreaded, [&](int32 begin, int32 end)
+        {
+            TArray<int32> candidates;
+            for (int32 idx = begin; idx < end; ++idx)
+            {
+                FVector & delta = points.collision_delta[idx];
+                delta = FVector(0, 0, 0);
+                if (!movable(idx))
+                {
+                    continue;
+                }
+                
+                candidates.Reset();
+                dense_grid_gather(points.collision_grid, points.pos, points.pos[idx], diameter, candidates);
+                for (int32 other : candidates)
+                {
+                    if (other == idx || lattice_neighbours(points, idx, other))
+                    {
+                        continue;
+                    }
+                    
+                    const FVector d = points.pos[idx] - points.pos[other];
+                    const float dist = d.Size();
+                    // coincident points separate along their rest offset
+                    const FVector n = dist > 0.0f ? d / dist : (topology.rest[idx] - topology.rest[other]).GetSafeNormal();
+                    delta += n * ((diameter - dist) * (movable(other) ? 0.5f : 1.0f));
+                    ++chunk_contacts[begin / chunk_points];
+                }
+            }
+        });
+    }
+    
+    int32 contacts = 0;
+    for (int32 chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        contacts += chunk_contacts[chunk];
+    }
+    if (!contacts)
+    {
+        return 0;
+    }
+    
+    solver_parallel_chunks(count, chunk_points, multithreaded, [&](int32 begin, int32 end)
+    {
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            const FVector & delta = points.collision_delta[idx];
+            const float size = delta.Size();
+            if (size > 0.0f)
+            {
+                push_out(points.pos[idx], points.vel[idx], delta / size, size, 0.0f);
+            }
+        }
+    });
+    return contacts;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+
+// Simple shapes of the world around a body, in the body's local space. The
+// game thread gathers them once per frame, every step of the frame keeps the
+// points outside of them.
+
+// solid below the plane, where dot(normal, p) < distance
+struct Collision_Plane
+{
+    FVector normal;
+    float distance;
+};
+
+struct Collision_Sphere
+{
+    FVector center;
+    float radius;
+};
+
+// every point within radius of the segment a b
+struct Collision_Capsule
+{
+    FVector a;
+    FVector b;
+    float radius;
+};
+
+// axes are unit length and orthogonal, extent is half the size along each
+struct Collision_Box
+{
+    FVector center;
+    FVector axes[3];
+    FVector extent;
+};
+
+struct Collision_World
+{
+    void reset()
+    {
+        planes.Reset();
+        spheres.Reset();
+        capsules.Reset();
+        boxes.Reset();
+    }
+    
+    bool is_empty() const
+    {
+        return !planes.Num() && !spheres.Num() && !capsules.Num() && !boxes.Num();
+    }
+    
+    TArray<Collision_Plane> planes;
+    TArray<Collision_Sphere> spheres;
+    TArray<Collision_Capsule> capsules;
+    TArray<Collision_Box> boxes;
+};
+
+struct Collision_Params
+{
+    // points keep this distance from world shapes and twice it from each other,
+    // 0 turns collision off
+    float thickness = 0.0f;
+    // tangential velocity a contact removes per unit of normal velocity it stops
+    float friction = 0.0f;
+    // push apart points that are not neighbours in the lattice
+    bool self_collision = false;
+};
+
+// Pushes the free points of awake chunks in [begin, end) out of the shapes of
+// world and removes the velocity that points into them. Returns the contacts.
+int32 collision_resolve_world(Particle_Store & points, const Collision_World & world, const Collision_Params & params, int32 begin, int32 end);
+
+// Separates points closer than twice the thickness that are not neighbours in
+// the lattice. The broad phase sorts every point into points.collision_grid
+// once per call, each point then moves by its own share of its overlaps, so the
+// result does not depend on the order or the threads. Returns the contacts.
+int32 collision_resolve_self(Particle_Store & points, const Collision_Params & params, bool multithreaded);
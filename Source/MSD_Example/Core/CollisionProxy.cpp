@@ -0,0 +1,181 @@
+#include "CollisionProxy.h"
+
+// face, edge and corner directions, the extremes of a block along them
+// outline its hull
+static const int32 PROXY_DIRECTIONS = 26;
+
+void proxy_build(Collision_Proxy & proxy, const TArray<FVector> & rest, float grid_size, int32 blocks_per_axis)
+{
+    proxy.reset();
+    const int32 count = rest.Num();
+    if (!count || grid_size <= 0.0f)
+    {
+        return;
+    }
+    
+    FVector directions[PROXY_DIRECTIONS];
+    int32 num_directions = 0;
+    for (int32 z = -1; z <= 1; ++z)
+    {
+        for (int32 y = -1; y <= 1; ++y)
+        {
+            for (int32 x = -1; x <= 1; ++x)
+            {
+                if (x || y || z)
+                {
+                    directions[num_directions++] = FVector(x, y, z);
+                }
+            }
+        }
+    }
+    
+    FVector lo = rest[0];
+    FVector hi = rest[0];
+    for (const FVector & p : rest)
+    {
+        lo = lo.ComponentMin(p);
+        hi = hi.ComponentMax(p);
+    }
+    
+    // block b along an axis spans the lattice layers [first[b], first[b + 1]],
+    // both ends included
+    const int32 blocks = FMath::Max(blocks_per_axis, 1);
+    int32 layers[3];
+    TArray<int32> first[3];
+    for (int32 axis = 0; axis < 3; ++axis)
+    {
+        layers[axis] = FMath::RoundToInt((hi[axis] - lo[axis]) / grid_size);
+        const int32 axis_blocks = FMath::Clamp(layers[axis], 1, blocks);
+        for (int32 b = 0; b <= axis_blocks; ++b)
+        {
+            first[axis].Add(layers[axis] * b / axis_blocks);
+        }
+    }
+    const int32 nx = first[0].Num() - 1;
+    const int32 ny = first[1].Num() - 1;
+    const int32 nz = first[2].Num() - 1;
+    const int32 num_blocks = nx * ny * nz;
+    
+    // best point per block and direction
+    TArray<int32> best;
+    TArray<float> best_score;
+    best.Init(INDEX_NONE, num_blocks * PROXY_DIRECTIONS);
+    best_score.Init(-MAX_flt, num_blocks * PROXY_DIRECTIONS);
+    
+    const float tie = grid_size * 0.01f;
+    int32 range_lo[3];
+    int32 range_hi[3];
+    for (int32 idx = 0; idx < count; ++idx)
+    {
+        const FVector & p = rest[idx];
+        for (int32 axis = 0; axis < 3; ++axis)
+        {
+            // a point on a block boundary belongs to the blocks on both sides
+            const int32 layer = FMath::RoundToInt((p[axis] - lo[axis]) / grid_size);
+            range_lo[axis] = 0;
+            while (range_lo[axis] + 1 < first[axis].Num() - 1 && first[axis][range_lo[axis] + 1] < layer)
+            {
+                ++range_lo[axis];
+            }
+            range_hi[axis] = range_lo[axis];
+            while (range_hi[axis] + 1 < first[axis].Num() - 1 && first[axis][range_hi[axis] + 1] <= layer)
+            {
+                ++range_hi[axis];
+            }
+        }
+        
+        for (int32 bz = range_lo[2]; bz <= range_hi[2]; ++bz)
+        {
+            for (int32 by = range_lo[1]; by <= range_hi[1]; ++by)
+            {
+                for (int32 bx = range_lo[0]; bx <= range_hi[0]; ++bx)
+                {
+                    const int32 block = (bz * ny + by) * nx + bx;
+                    const FVector center = lo + FVector(first[0][bx] + first[0][bx + 1], first[1][by] + first[1][by + 1], first[2][bz] + first[2][bz + 1]) * (grid_size * 0.5f);
+                    const float center_dist = FVector::DistSquared(p, center);
+                    for (int32 d = 0; d < PROXY_DIRECTIONS; ++d)
+                    {
+                        // of the points as far out, the one closest to the block
+                        // center, so a face direction takes the middle of the face
+                        const float score = FVector::DotProduct(directions[d], p);
+                        const int32 slot = block * PROXY_DIRECTIONS + d;
+                        const int32 other = best[slot];
+                        if (other == INDEX_NONE || score > best_score[slot] + tie ||
+                            (score > best_score[slot] - tie && center_dist < FVector::DistSquared(rest[other], center)))
+                        {
+                            best_score[slot] = FMath::Max(score, best_score[slot]);
+                            best[slot] = idx;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    proxy.hull_offsets.Add(0);
+    for (int32 block = 0; block < num_blocks; ++block)
+    {
+        const int32 hull_begin = proxy.hull_points.Num();
+        for (int32 d = 0; d < PROXY_DIRECTIONS; ++d)
+        {
+            // corners win several directions, each point goes in once
+            const int32 idx = best[block * PROXY_DIRECTIONS + d];
+            bool listed = idx == INDEX_NONE;
+            for (int32 i = hull_begin; i < proxy.hull_points.Num() && !listed; ++i)
+            {
+                listed = proxy.hull_points[i] == idx;
+            }
+            if (!listed)
+            {
+                proxy.hull_points.Add(idx);
+            }
+        }
+        
+        // flat blocks of one layer cook into nothing
+        if (proxy.hull_points.Num() - hull_begin < 4)
+        {
+            proxy.hull_points.SetNum(hull_begin);
+            continue;
+        }
+        proxy.hull_offsets.Add(proxy.hull_points.Num());
+    }
+    if (proxy.hull_offsets.Num() == 1)
+    {
+        proxy.hull_offsets.Reset();
+    }
+}
+
+bool proxy_needs_refit(const Collision_Proxy & proxy, const TArray<FVector> & positions, float tolerance)
+{
+    if (proxy.cooked_pos.Num() != proxy.hull_points.Num())
+    {
+        return true;
+    }
+    
+    const float tolerance_sq = tolerance * tolerance;
+    for (int32 i = 0; i < proxy.hull_points.Num(); ++i)
+    {
+        if (FVector::DistSquared(positions[proxy.hull_points[i]], proxy.cooked_pos[i]) > tolerance_sq)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void proxy_refit(Collision_Proxy & proxy, const TArray<FVector> & positions, TArray<TArray<FVector>> & hulls)
+{
+    const int32 num_hulls = proxy.num_hulls();
+    proxy.cooked_pos.SetNumUninitialized(proxy.hull_points.Num());
+    hulls.SetNum(num_hulls);
+    for (int32 h = 0; h < num_hulls; ++h)
+    {
+        TArray<FVector> & hull = hulls[h];
+        hull.Reset();
+        for (int32 i = proxy.hull_offsets[h]; i < proxy.hull_offsets[h + 1]; ++i)
+        {
+            proxy.cooked_pos[i] = positions[proxy.hull_points[i]];
+            hull.Add(proxy.cooked_pos[i]);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "MSDCore.h"
+
+// Coarse convex collision of a deformed body for traces and physics. The rest
+// lattice is split into blocks_per_axis^3 blocks, each block becomes one hull
+// over at most 26 of its points: the ones furthest out along the face, edge and
+// corner directions. Blocks share their boundary layer of points, so the hulls
+// touch and leave no gaps. The layout is built once per generation, later
+// frames only move the hull vertices to the current positions and only when a
+// vertex moved further than the tolerance since the last cook.
+struct Collision_Proxy
+{
+    void reset()
+    {
+        hull_offsets.Reset();
+        hull_points.Reset();
+        cooked_pos.Reset();
+    }
+    
+    int32 num_hulls() const { return hull_offsets.Num() ? hull_offsets.Num() - 1 : 0; }
+    
+    // hull h is over the points hull_points[hull_offsets[h] .. hull_offsets[h + 1])
+    TArray<int32> hull_offsets;
+    TArray<int32> hull_points;
+    // positions of hull_points the current hulls were cooked from
+    TArray<FVector> cooked_pos;
+};
+
+// Lays out the hulls over the rest pose, grid_size apart. Blocks with too few
+// points for a solid hull are left out.
+void proxy_build(Collision_Proxy & proxy, const TArray<FVector> & rest, float grid_size, int32 blocks_per_axis);
+
+// Whether a hull vertex moved further than tolerance from where it was cooked.
+bool proxy_needs_refit(const Collision_Proxy & proxy, const TArray<FVector> & positions, float tolerance);
+
+// Writes the vertices of every hull at positions and remembers them as cooked.
+void proxy_refit(Collision_Proxy & proxy, const TArray<FVector> & positions, TArray<TArray<FVector>> & hulls);
@@ -0,0 +1,709 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Generator.h"
+
+
+int32 calc(const FIntVector & index, const FIntVector & size)
+{
+    return (size.Y * size.X * index.Z) + (size.X * index.Y) + index.X;
+};
+
+
+// Every spring direction of a lattice point: the 6 axis neighbours, the 12
+// face diagonals and the 6 points two steps along an axis. Each direction is
+// followed by its opposite. The forward one (last non zero component positive,
+// odd entries) leads to a later point and never to an earlier slice, the
+// spring table starts its springs from there.
+struct Lattice_Link
+{
+    FIntVector offset;
+    Spring_Type type;
+};
+
+static const Lattice_Link lattice_links[] =
+{
+    { FIntVector(-1, 0, 0), SpringType_Structural }, { FIntVector(1, 0, 0), SpringType_Structural },
+    { FIntVector(0, -1, 0), SpringType_Structural }, { FIntVector(0, 1, 0), SpringType_Structural },
+    { FIntVector(0, 0, -1), SpringType_Structural }, { FIntVector(0, 0, 1), SpringType_Structural },
+    { FIntVector(-1, -1, 0), SpringType_Shear }, { FIntVector(1, 1, 0), SpringType_Shear },
+    { FIntVector(1, -1, 0), SpringType_Shear }, { FIntVector(-1, 1, 0), SpringType_Shear },
+    { FIntVector(-1, 0, -1), SpringType_Shear }, { FIntVector(1, 0, 1), SpringType_Shear },
+    { FIntVector(1, 0, -1), SpringType_Shear }, { FIntVector(-1, 0, 1), SpringType_Shear },
+    { FIntVector(0, -1, -1), SpringType_Shear }, { FIntVector(0, 1, 1), SpringType_Shear },
+    { FIntVector(0, 1, -1), SpringType_Shear }, { FIntVector(0, -1, 1), SpringType_Shear },
+    { FIntVector(-2, 0, 0), SpringType_Bend }, { FIntVector(2, 0, 0), SpringType_Bend },
+    { FIntVector(0, -2, 0), SpringType_Bend }, { FIntVector(0, 2, 0), SpringType_Bend },
+    { FIntVector(0, 0, -2), SpringType_Bend }, { FIntVector(0, 0, 2), SpringType_Bend }
+};
+
+#define NUM_LATTICE_LINKS 24
+
+static float link_stiffness(Spring_Type type, const Lattice_Key & key)
+{
+    switch (type)
+    {
+        case SpringType_Shear: return key.shear_stiffness;
+        case SpringType_Bend:  return key.bend_stiffness;
+        default:               return 1.0f;
+    }
+}
+
+Lattice_Key make_lattice_key(FVector dimension, float grid_size, Surface_Mode surface_mode, int32 shell_layers, float shear_stiffness, float bend_stiffness)
+{
+    Lattice_Key key;
+    key.size = FIntVector(FMath::RoundToInt(dimension.X / grid_size) + 1,
+                          FMath::RoundToInt(dimension.Y / grid_size) + 1,
+                          FMath::RoundToInt(dimension.Z / grid_size) + 1);
+    key.grid_size = grid_size;
+    key.surface_mode = surface_mode;
+    key.shell_layers = FMath::Max(shell_layers, 0);
+    key.shear_stiffness = FMath::Max(shear_stiffness, 0.0f);
+    key.bend_stiffness = FMath::Max(bend_stiffness, 0.0f);
+    return key;
+}
+
+bool in_shell(const FIntVector & index, const FIntVector & size, int32 shell_layers)
+{
+    if (shell_layers <= 0)
+    {
+        return true;
+    }
+    const int32 depth = FMath::Min(FMath::Min3(index.X, index.Y, index.Z),
+                                   FMath::Min3(size.X - 1 - index.X, size.Y - 1 - index.Y, size.Z - 1 - index.Z));
+    return depth < shell_layers;
+}
+
+static bool link_target(const FIntVector & index, int32 link, const Lattice_Key & key, FIntVector & other)
+{
+    const FIntVector & size = key.size;
+    other = index + lattice_links[link].offset;
+    return other.X >= 0 && other.Y >= 0 && other.Z >= 0 && other.X < size.X && other.Y < size.Y && other.Z < size.Z &&
+        in_shell(other, size, key.shell_layers);
+}
+
+int32 get_links(const FIntVector & index, const Lattice_Key & key, const int32 * grid_point, int32 * result, float * stiffness)
+{
+    int32 count = 0;
+    for (int32 link = 0; link < NUM_LATTICE_LINKS; ++link)
+    {
+        const float weight = link_stiffness(lattice_links[link].type, key);
+        FIntVector other;
+        if (weight <= 0.0f || !link_target(index, link, key, other))
+        {
+            continue;
+        }
+        if (result)
+        {
+            const int32 cell = calc(other, key.size);
+            result[count] = grid_point ? grid_point[cell] : cell;
+            stiffness[count] = weight;
+        }
+        ++count;
+    }
+    return count;
+}
+
+Lattice_Counts lattice_counts(const Lattice_Key & key)
+{
+    const FIntVector & size = key.size;
+    const int32 shell_layers = key.shell_layers;
+    Lattice_Counts counts;
+    counts.points = size.X * size.Y * size.Z;
+    // every axis aligned spring, stored once from each end
+    counts.neighbours = 2 * ((size.X - 1) * size.Y * size.Z + size.X * (size.Y - 1) * size.Z + size.X * size.Y * (size.Z - 1));
+    
+    if (shell_layers > 0)
+    {
+        const int32 interior = FMath::Max(size.X - 2 * shell_layers, 0) * FMath::Max(size.Y - 2 * shell_layers, 0) * FMath::Max(size.Z - 2 * shell_layers, 0);
+        counts.points -= interior;
+    }
+    
+    if (shell_layers > 0 || key.shear_stiffness > 0.0f || key.bend_stiffness > 0.0f)
+    {
+        // no closed form for the links that stay inside the shell
+        counts.neighbours = 0;
+        FIntVector i;
+        for (i.Z = 0; i.Z < size.Z; ++i.Z)
+        {
+            for (i.Y = 0; i.Y < size.Y; ++i.Y)
+            {
+                for (i.X = 0; i.X < size.X; ++i.X)
+                {
+                    if (in_shell(i, size, shell_layers))
+                    {
+                        counts.neighbours += get_links(i, key, nullptr, nullptr, nullptr);
+                    }
+                }
+            }
+        }
+    }
+    
+    const int32 quads = 2 * ((size.X - 1) * (size.Y - 1) + (size.X - 1) * (size.Z - 1) + (size.Y - 1) * (size.Z - 1));
+    counts.indices = 6 * quads;
+    
+    switch (key.surface_mode)
+    {
+        case SurfaceMode_Quads:
+            counts.vertices = 4 * quads;
+            break;
+        case SurfaceMode_SharedFaces:
+            counts.vertices = 2 * (size.X * size.Y + size.X * size.Z + size.Y * size.Z);
+            break;
+        default:
+            counts.vertices = size.X * size.Y * size.Z - FMath::Max(size.X - 2, 0) * FMath::Max(size.Y - 2, 0) * FMath::Max(size.Z - 2, 0);
+            break;
+    }
+    return counts;
+}
+
+void generateMesh(Mesh_Section & mesh_section, const Lattice_Key & key)
+{
+    const FIntVector size = key.size;
+    const float grid_size = key.grid_size;
+    const Surface_Mode surface_mode = key.surface_mode;
+    const int32 shell_layers = key.shell_layers;
+    const FVector dim((size.X - 1) * grid_size, (size.Y - 1) * grid_size, (size.Z - 1) * grid_size);
+    FVector half = dim / 2;
+    mesh_section.size = FVector((float)size.X, (float)size.Y, (float)size.Z);
+    
+    // everything is sized exactly once up front and filled through cursors.
+    // Reset keeps the allocations, so regenerating at a similar size does not
+    // go back to the allocator at all
+    const Lattice_Counts counts = lattice_counts(key);
+    const int32 mass_point_count = counts.points;
+    
+    // shells only keep the grid points near the surface, numbered in grid order
+    TArray<int32> grid_point;
+    if (shell_layers > 0)
+    {
+        grid_point.SetNumUninitialized(size.X * size.Y * size.Z);
+        int32 next = 0;
+        FIntVector i;
+        for (i.Z = 0; i.Z < size.Z; ++i.Z)
+        {
+            for (i.Y = 0; i.Y < size.Y; ++i.Y)
+            {
+                for (i.X = 0; i.X < size.X; ++i.X)
+                {
+                    grid_point[calc(i, size)] = in_shell(i, size, shell_layers) ? next++ : INDEX_NONE;
+                }
+            }
+        }
+    }
+    auto point_of = [&](const FIntVector & index) -> int32
+    {
+        const int32 cell = calc(index, size);
+        return grid_point.Num() ? grid_point[cell] : cell;
+    };
+    
+    Lattice_Topology & lattice = mesh_section.lattice;
+    lattice.reset();
+    lattice.rest.SetNumUninitialized(mass_point_count);
+    lattice.side.SetNumUninitialized(mass_point_count);
+    lattice.neighbour_offsets.SetNumUninitialized(mass_point_count + 1);
+    lattice.neighbour_list.SetNumUninitialized(counts.neighbours);
+    lattice.neighbour_spring.SetNumUninitialized(counts.neighbours);
+    lattice.point_stiffness.SetNumUninitialized(mass_point_count);
+    lattice.axis_springs_only = key.shear_stiffness <= 0.0f && key.bend_stiffness <= 0.0f;
+    
+    const int32 num_springs = counts.neighbours / 2;
+    lattice.spring_a.SetNumUninitialized(num_springs);
+    lattice.spring_b.SetNumUninitialized(num_springs);
+    lattice.spring_rest.SetNumUninitialized(num_springs);
+    lattice.spring_stiffness.SetNumUninitialized(num_springs);
+    lattice.spring_type.SetNumUninitialized(num_springs);
+    lattice.spring_block_offsets.Reset();
+    lattice.spring_block_offsets.Add(0);
+    
+    // owning mass point of every render vertex, turned into the vertex CSR once all quads are emitted
+    Surface_Topology & surface = mesh_section.surface;
+    surface.reset();
+    TArray<int32> & vertex_point = surface.vertex_point;
+    vertex_point.SetNumUninitialized(counts.vertices);
+    mesh_section.vertices.SetNumUninitialized(counts.vertices);
+    surface.rest_normal.SetNumUninitialized(counts.vertices);
+    surface.rest_tangent.SetNumUninitialized(counts.vertices);
+    surface.uv.SetNumUninitialized(counts.vertices);
+    mesh_section.triangles.SetNumUninitialized(counts.indices);
+    
+    int32 vertex_cursor = 0;
+    int32 index_cursor = 0;
+    int32 neighbour_cursor = 0;
+    int32 spring_cursor = 0;
+    int32 block_slices = 0;
+    
+    auto AddVertex = [&](const FVector& p, const FVector& Normal, const FVector& Tangent, const FVector2D& uv, int32 point) -> int32
+    {
+        const int32 v = vertex_cursor++;
+        vertex_point[v] = point;
+        surface.rest_normal[v] = Normal;
+        surface.rest_tangent[v] = Tangent;
+        surface.uv[v] = uv;
+        mesh_section.vertices[v] = p;
+        return v;
+    };
+    
+    // two triangles, wound like URuntimeMeshShapeGenerator::ConvertQuadToTriangles
+    auto AddQuad = [&](int32 v0, int32 v1, int32 v2, int32 v3)
+    {
+        int32 * t = mesh_section.triangles.GetData() + index_cursor;
+        index_cursor += 6;
+        t[0] = v0; t[1] = v1; t[2] = v3;
+        t[3] = v1; t[4] = v2; t[5] = v3;
+    };
+    
+    // Shared modes look up the vertex a surface point already has on a face
+    // (SurfaceMode_SharedFaces, one 2D slot table per face) or at all
+    // (SurfaceMode_Smooth, one slot per point) before adding a new one.
+    TArray<int32> face_vertices[6];
+    TArray<int32> point_vertices;
+    if (surface_mode == SurfaceMode_SharedFaces)
+    {
+        face_vertices[0].Init(INDEX_NONE, size.X * size.Y);
+        face_vertices[1].Init(INDEX_NONE, size.X * size.Y);
+        face_vertices[2].Init(INDEX_NONE, size.X * size.Z);
+        face_vertices[3].Init(INDEX_NONE, size.X * size.Z);
+        face_vertices[4].Init(INDEX_NONE, size.Y * size.Z);
+        face_vertices[5].Init(INDEX_NONE, size.Y * size.Z);
+    }
+    else if (surface_mode == SurfaceMode_Smooth)
+    {
+        point_vertices.Init(INDEX_NONE, mass_point_count);
+    }
+    
+    // smooth vertices average the normals and tangents of every face they are on
+    TArray<FVector> normal_sum;
+    TArray<FVector> tangent_sum;
+    if (surface_mode == SurfaceMode_Smooth)
+    {
+        normal_sum.SetNumZeroed(counts.vertices);
+        tangent_sum.SetNumZeroed(counts.vertices);
+    }
+    
+    auto face_slot = [&](int32 face, const FIntVector & index) -> int32
+    {
+        switch (face)
+        {
+            case 0: case 1: return index.X + index.Y * size.X;
+            case 2: case 3: return index.X + index.Z * size.X;
+            default:        return index.Y + index.Z * size.Y;
+        }
+    };
+    
+    auto SharedVertex = [&](int32 face,
+                            const FIntVector& index,
+                            const FVector& p,
+                            const FVector2D& uv,
+                            const FVector& Normal,
+                            const FVector& Tangent) -> int32
+    {
+        int32 point = point_of(index);
+        int32 & slot = surface_mode == SurfaceMode_Smooth ? point_vertices[point] : face_vertices[face][face_slot(face, index)];
+        
+        if (slot == INDEX_NONE)
+        {
+            slot = AddVertex(p, Normal, Tangent, uv, point);
+        }
+        
+        if (surface_mode == SurfaceMode_Smooth)
+        {
+            normal_sum[slot] += Normal;
+            tangent_sum[slot] += Tangent;
+        }
+        return slot;
+    };
+    
+    auto VerticesBuilder = [&](int32 face,
+                               const FIntVector& index,
+                               const FVector& p0,
+                               const FIntVector& s1,
+                               const FIntVector& s2,
+                               const FIntVector& s3,
+                               const FVector& Normal,
+                               const FVector& Tangent)
+	{
+        FIntVector i1 = index + s1;
+        FIntVector i2 = index + s2;
+        FIntVector i3 = index + s3;
+        
+        FVector p1 = p0 + FVector((float)s1.X, (float)s1.Y, (float)s1.Z) * grid_size;
+        FVector p2 = p0 + FVector((float)s2.X, (float)s2.Y, (float)s2.Z) * grid_size;
+        FVector p3 = p0 + FVector((float)s3.X, (float)s3.Y, (float)s3.Z) * grid_size;
+        
+        if (surface_mode != SurfaceMode_Quads)
+        {
+            // UVs in grid steps along the face, wrapping textures tile per
+            // quad exactly like the 0..1 UVs of the per quad vertices
+            auto dot = [](const FIntVector & a, const FIntVector & b) { return (float)(a.X * b.X + a.Y * b.Y + a.Z * b.Z); };
+            auto uv = [&](const FIntVector & i) { return FVector2D(dot(i, s3), dot(i, s1)); };
+            
+            int32 idx = SharedVertex(face, index, p0, uv(index), Normal, Tangent);
+            int32 idx1 = SharedVertex(face, i1, p1, uv(i1), Normal, Tangent);
+            int32 idx2 = SharedVertex(face, i2, p2, uv(i2), Normal, Tangent);
+            int32 idx3 = SharedVertex(face, i3, p3, uv(i3), Normal, Tangent);
+            
+            AddQuad(idx, idx1, idx2, idx3);
+            return;
+        }
+        
+        int32 idx = AddVertex(p0, Normal, Tangent, FVector2D(0.0f, 0.0f), point_of(index));
+        int32 idx1 = AddVertex(p1, Normal, Tangent, FVector2D(0.0f, 1.0f), point_of(i1));
+        int32 idx2 = AddVertex(p2, Normal, Tangent, FVector2D(1.0f, 1.0f), point_of(i2));
+        int32 idx3 = AddVertex(p3, Normal, Tangent, FVector2D(1.0f, 0.0f), point_of(i3));
+        
+        AddQuad(idx, idx1, idx2, idx3);
+    };
+    
+    
+    FIntVector i(0, 0, 0);
+    FVector Normal;
+    FVector Tangent;
+    
+    for (i.Z = 0; i.Z < size.Z; ++i.Z)
+    {
+        if (block_slices >= 2 && spring_cursor - lattice.spring_block_offsets.Last() >= LATTICE_SPRING_BLOCK)
+        {
+            lattice.spring_block_offsets.Add(spring_cursor);
+            block_slices = 0;
+        }
+        ++block_slices;
+        
+        for (i.Y = 0; i.Y < size.Y; ++i.Y)
+        {
+            for (i.X = 0; i.X < size.X; ++i.X)
+            {
+                if (!in_shell(i, size, shell_layers))
+                {
+                    // interior of a shell, never on a face either
+                    continue;
+                }
+                
+                int idx = point_of(i);
+                
+                lattice.neighbour_offsets[idx] = neighbour_cursor;
+                float stiffness[NUM_LATTICE_LINKS];
+                const int32 links = get_links(i, key, grid_point.Num() ? grid_point.GetData() : nullptr,
+                                              lattice.neighbour_list.GetData() + neighbour_cursor, stiffness);
+                neighbour_cursor += links;
+                
+                float & point_stiffness = lattice.point_stiffness[idx];
+                point_stiffness = 0.0f;
+                for (int32 l = 0; l < links; ++l)
+                {
+                    point_stiffness += stiffness[l];
+                }
+                
+                // the forward links start a spring here, the backward ones were added by the other end
+                for (int32 link = 1; link < NUM_LATTICE_LINKS; link += 2)
+                {
+                    const Spring_Type type = lattice_links[link].type;
+                    FIntVector other;
+                    if (link_stiffness(type, key) <= 0.0f || !link_target(i, link, key, other))
+                    {
+                        continue;
+                    }
+                    const int32 s = spring_cursor++;
+                    lattice.spring_a[s] = idx;
+                    lattice.spring_b[s] = point_of(other);
+                    lattice.spring_stiffness[s] = link_stiffness(type, key);
+                    lattice.spring_type[s] = (uint8)type;
+                }
+                
+                // every point on a face, not just the quad corners
+                uint8 & side = lattice.side[idx];
+                side = CubeSide_None;
+                side |= i.X == 0 ? CubeSide_Front : 0;
+                side |= i.X == size.X - 1 ? CubeSide_Back : 0;
+                side |= i.Y == 0 ? CubeSide_Left : 0;
+                side |= i.Y == size.Y - 1 ? CubeSide_Right : 0;
+                side |= i.Z == size.Z - 1 ? CubeSide_Top : 0;
+                side |= i.Z == 0 ? CubeSide_Bottom : 0;
+                lattice.rest[idx] = FVector((float)i.X, (float)i.Y, (float)i.Z) * grid_size - half;
+                FVector vp0 = lattice.rest[idx];
+                
+
+                if (i.X < (size.X - 1) && i.Y < (size.Y - 1) && i.Z == 0)
+                {
+                    // -Z
+                    Normal = FVector(0.0f, 0.0f, -1.0f);
+                    Tangent = FVector(0.0f, 1.0f, 0.0f);
+                    
+                    FIntVector vp1 = FIntVector(1, 0, 0);
+                    FIntVector vp2 = FIntVector(1, 1, 0);
+                    FIntVector vp3 = FIntVector(0, 1, 0);
+                    
+                    VerticesBuilder(0, i, vp0, vp1, vp2, vp3, Normal, Tangent);
+                }
+                
+                if (i.X < (size.X - 1) && i.Y < (size.Y - 1) && i.Z == (size.Z - 1))
+                {
+                    // +Z
+                    Normal = FVector(0.0f, 0.0f, 1.0f);
+                    Tangent = FVector(0.0f, -1.0f, 0.0f);
+                    
+                    FIntVector vp1 = FIntVector(0, 1, 0);
+                    FIntVector vp2 = FIntVector(1, 1, 0);
+                    FIntVector vp3 = FIntVector(1, 0, 0);
+                    
+                    VerticesBuilder(1, i, vp0, vp1, vp2, vp3, Normal, Tangent);
+                }
+                
+                if (i.X < (size.X - 1) && i.Y == 0 && i.Z < (size.Z - 1))
+                {
+                    // -Y
+                    Normal = FVector(0.0f, -1.0f, 0.0f);
+                    Tangent = FVector(1.0f, 0.0f, 0.0f);
+                    
+                    FIntVector vp1 = FIntVector(0, 0, 1);
+                    FIntVector vp2 = FIntVector(1, 0, 1);
+                    FIntVector vp3 = FIntVector(1, 0, 0);
+                    
+                    VerticesBuilder(2, i, vp0, vp1, vp2, vp3, Normal, Tangent);
+                }
+                
+                if (i.X < (size.X - 1) && i.Y == (size.Y - 1) && i.Z < (size.Z - 1))
+                {
+                    // +Y
+                    Normal = FVector(0.0f, 1.0f, 0.0f);
+                    Tangent = FVector(-1.0f, 0.0f, 0.0f);
+                    
+                    FIntVector vp1 = FIntVector(1, 0, 0);
+                    FIntVector vp2 = FIntVector(1, 0, 1);
+                    FIntVector vp3 = FIntVector(0, 0, 1);
+                    
+                    VerticesBuilder(3, i, vp0, vp1, vp2, vp3, Normal, Tangent);
+                }
+                
+                if (i.X == 0 && i.Y < (size.Y - 1) && i.Z < (size.Z - 1))
+                {
+                    // -X
+                    Normal = FVector(-1.0f, 0.0f, 0.0f);
+                    Tangent = FVector(0.0f, -1.0f, 0.0f);
+                    
+                    FIntVector vp1 = FIntVector(0, 1, 0);
+                    FIntVector vp2 = FIntVector(0, 1, 1);
+                    FIntVector vp3 = FIntVector(0, 0, 1);
+                    
+                    VerticesBuilder(4, i, vp0, vp1, vp2, vp3, Normal, Tangent);
+                }
+                
+                if (i.X == (size.X - 1) && i.Y < (size.Y - 1) && i.Z < (size.Z - 1))
+                {
+                    // +X
+                    Normal = FVector(1.0f, 0.0f, 0.0f);
+                    Tangent = FVector(0.0f, 1.0f, 0.0f);
+                    
+                    FIntVector vp1 = FIntVector(0, 0, 1);
+                    FIntVector vp2 = FIntVector(0, 1, 1);
+                    FIntVector vp3 = FIntVector(0, 1, 0);
+                    
+                    VerticesBuilder(5, i, vp0, vp1, vp2, vp3, Normal, Tangent);
+                }
+            }
+        }
+    }
+    
+    lattice.neighbour_offsets[mass_point_count] = neighbour_cursor;
+    lattice.spring_block_offsets.Add(spring_cursor);
+    const int32 * neighbour_offsets = lattice.neighbour_offsets.GetData();
+    const int32 * neighbour_list = lattice.neighbour_list.GetData();
+    int32 * neighbour_spring = lattice.neighbour_spring.GetData();
+    for (int32 s = 0; s < num_springs; ++s)
+    {
+        // the far end had no rest position yet when the spring was added
+        const int32 a = lattice.spring_a[s];
+        const int32 b = lattice.spring_b[s];
+        lattice.spring_rest[s] = lattice.rest[a] - lattice.rest[b];
+        
+        // and its neighbour entries did not exist yet either
+        for (int32 n = neighbour_offsets[a]; n < neighbour_offsets[a + 1]; ++n)
+        {
+            neighbour_spring[n] = neighbour_list[n] == b ? s : neighbour_spring[n];
+        }
+        for (int32 n = neighbour_offsets[b]; n < neighbour_offsets[b + 1]; ++n)
+        {
+            neighbour_spring[n] = neighbour_list[n] == a ? s : neighbour_spring[n];
+        }
+    }
+    
+    if (surface_mode == SurfaceMode_Smooth)
+    {
+        for (int32 v = 0; v < counts.vertices; ++v)
+        {
+            FVector n = normal_sum[v].GetSafeNormal();
+            surface.rest_normal[v] = n;
+            surface.rest_tangent[v] = (tangent_sum[v] - n * FVector::DotProduct(tangent_sum[v], n)).GetSafeNormal();
+        }
+    }
+    
+    // counting sort of the render vertices by owning mass point
+    lattice.vertex_offsets.SetNumZeroed(mass_point_count + 1);
+    for (int32 m : vertex_point)
+    {
+        ++lattice.vertex_offsets[m + 1];
+    }
+    for (int32 m = 0; m < mass_point_count; ++m)
+    {
+        lattice.vertex_offsets[m + 1] += lattice.vertex_offsets[m];
+    }
+    
+    TArray<int32> cursor(lattice.vertex_offsets.GetData(), mass_point_count);
+    lattice.vertex_list.SetNum(vertex_point.Num());
+    for (int32 v = 0; v < vertex_point.Num(); ++v)
+    {
+        lattice.vertex_list[cursor[vertex_point[v]]++] = v;
+    }
+    
+    // same for the triangles around every render vertex
+    const TArray<int32> & triangles = mesh_section.triangles;
+    surface.triangle_offsets.SetNumZeroed(vertex_point.Num() + 1);
+    for (int32 v : triangles)
+    {
+        ++surface.triangle_offsets[v + 1];
+    }
+    for (int32 v = 0; v < vertex_point.Num(); ++v)
+    {
+        surface.triangle_offsets[v + 1] += surface.triangle_offsets[v];
+    }
+    
+    cursor = TArray<int32>(surface.triangle_offsets.GetData(), vertex_point.Num());
+    surface.triangle_list.SetNum(triangles.Num());
+    for (int32 t = 0; t < triangles.Num(); ++t)
+    {
+        surface.triangle_list[cursor[triangles[t]]++] = t - t % 3;
+    }
+    
+}
+
+void init_particles(Particle_Store & points, const Lattice_Topology & lattice, float mass)
+{
+    points.topology = &lattice;
+    points.pos.SetNumUninitialized(lattice.Num());
+    points.vel.SetNumUninitialized(lattice.Num());
+    points.inv_mass.SetNumUninitialized(lattice.Num());
+    reset_to_rest(points);
+    apply_material(points, mass, TArray<Material_Paint>());
+}
+
+static bool paint_covers(const Material_Paint & paint, const Lattice_Topology & lattice, int32 idx)
+{
+    if (lattice.side[idx] & paint.side_mask)
+    {
+        return true;
+    }
+    const FVector & p = lattice.rest[idx];
+    return paint.use_box && p.X >= paint.box_min.X && p.Y >= paint.box_min.Y && p.Z >= paint.box_min.Z &&
+        p.X <= paint.box_max.X && p.Y <= paint.box_max.Y && p.Z <= paint.box_max.Z;
+}
+
+void apply_material(Particle_Store & points, float mass, const TArray<Material_Paint> & paints)
+{
+    const Lattice_Topology & lattice = *points.topology;
+    const int32 count = points.Num();
+    const float inv_mass = 1.0f / mass;
+    for (float & value : points.inv_mass)
+    {
+        value = inv_mass;
+    }
+    points.free_runs.Reset();
+    points.spring_stiffness.Reset();
+    points.spring_damping.Reset();
+    points.point_damping.Reset();
+    // yielded and torn springs heal with the new material
+    points.spring_rest.Reset();
+    points.torn_springs.Reset();
+    points.torn_weights.Reset();
+    ++points.material_version;
+    
+    TArray<float> stiffness_scale;
+    TArray<float> damping_scale;
+    bool weighted = false;
+    for (const Material_Paint & paint : paints)
+    {
+        weighted |= paint.stiffness_scale != 1.0f || paint.damping_scale != 1.0f;
+    }
+    if (weighted)
+    {
+        stiffness_scale.Init(1.0f, count);
+        damping_scale.Init(1.0f, count);
+    }
+    
+    int32 run_begin = INDEX_NONE;
+    for (int32 idx = 0; idx < count; ++idx)
+    {
+        bool pinned = false;
+        for (const Material_Paint & paint : paints)
+        {
+            if (!paint_covers(paint, lattice, idx))
+            {
+                continue;
+            }
+            points.inv_mass[idx] = inv_mass / paint.mass_scale;
+            pinned |= paint.pinned;
+            if (weighted)
+            {
+                stiffness_scale[idx] = paint.stiffness_scale;
+                damping_scale[idx] = paint.damping_scale;
+            }
+        }
+        
+        if (pinned)
+        {
+            points.inv_mass[idx] = 0.0f;
+            if (run_begin != INDEX_NONE)
+            {
+                points.free_runs.Add(run_begin);
+                points.free_runs.Add(idx);
+                run_begin = INDEX_NONE;
+            }
+        }
+        else if (run_begin == INDEX_NONE)
+        {
+            run_begin = idx;
+        }
+    }
+    if (run_begin != INDEX_NONE)
+    {
+        points.free_runs.Add(run_begin);
+        points.free_runs.Add(count);
+    }
+    
+    if (!weighted)
+    {
+        // uniform springs keep using the topology's weights
+        return;
+    }
+    
+    const int32 num_springs = lattice.num_springs();
+    points.spring_stiffness.SetNumUninitialized(num_springs);
+    points.spring_damping.SetNumUninitialized(num_springs);
+    for (int32 s = 0; s < num_springs; ++s)
+    {
+        const int32 a = lattice.spring_a[s];
+        const int32 b = lattice.spring_b[s];
+        points.spring_stiffness[s] = lattice.spring_stiffness[s] * 0.5f * (stiffness_scale[a] + stiffness_scale[b]);
+        points.spring_damping[s] = lattice.spring_stiffness[s] * 0.5f * (damping_scale[a] + damping_scale[b]);
+    }
+    
+    points.point_damping.SetNumUninitialized(count);
+    for (int32 idx = 0; idx < count; ++idx)
+    {
+        float sum = 0.0f;
+        for (int32 n = lattice.neighbour_offsets[idx]; n < lattice.neighbour_offsets[idx + 1]; ++n)
+        {
+            sum += points.spring_damping[lattice.neighbour_spring[n]];
+        }
+        points.point_damping[idx] = sum;
+    }
+}
+
+void reset_to_rest(Particle_Store & points)
+{
+    const int32 count = points.Num();
+    FMemory::Memcpy(points.pos.GetData(), points.topology->rest.GetData(), count * sizeof(FVector));
+    FMemory::Memzero(points.vel.GetData(), count * sizeof(FVector));
+    // the solver sizes these again on its next step
+    points.pos_next.Reset();
+    points.vel_next.Reset();
+    points.sleep.reset();
+}
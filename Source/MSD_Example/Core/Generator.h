@@ -0,0 +1,392 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MSDCore.h"
+#include "SpatialIndex.h"
+
+#define DEBUG_TIME 20.0f
+
+// springs a block of the spring table is at least cut at
+#define LATTICE_SPRING_BLOCK 4096
+
+#define pi32   3.14159265359f
+#define tau32  6.28318530717958647692f
+
+enum Cube_Side
+{
+    CubeSide_None   = 0,
+    CubeSide_Front  = 1,
+    CubeSide_Back   = 2,
+    CubeSide_Left   = 4,
+    CubeSide_Right  = 8,
+    CubeSide_Top    = 16,
+    CubeSide_Bottom = 32
+};
+
+// How generateMesh builds the render surface.
+enum Surface_Mode
+{
+    // four vertices per quad, every surface point is duplicated up to 12 times
+    SurfaceMode_Quads = 0,
+    // one vertex per surface point and face, flat shaded like the quads
+    SurfaceMode_SharedFaces,
+    // one vertex per surface point, normals averaged across faces
+    SurfaceMode_Smooth
+};
+
+// What a spring connects, see lattice_links in Generator.cpp.
+enum Spring_Type
+{
+    // axis neighbours
+    SpringType_Structural = 0,
+    // face diagonals, resist shear
+    SpringType_Shear,
+    // two steps along an axis, resist bending
+    SpringType_Bend
+};
+
+// Generation parameters a lattice is fully determined by.
+struct Lattice_Key
+{
+    bool operator==(const Lattice_Key & other) const
+    {
+        return size == other.size && grid_size == other.grid_size && surface_mode == other.surface_mode && shell_layers == other.shell_layers
+            && shear_stiffness == other.shear_stiffness && bend_stiffness == other.bend_stiffness;
+    }
+    bool operator!=(const Lattice_Key & other) const { return !(*this == other); }
+
+    // mass points along each axis
+    FIntVector size;
+    float grid_size;
+    Surface_Mode surface_mode;
+    // 0 for the full volume, see in_shell
+    int32 shell_layers;
+    // stiffness of the shear and bend springs as a fraction of k, 0 leaves them out
+    float shear_stiffness;
+    float bend_stiffness;
+};
+
+Lattice_Key make_lattice_key(FVector dimension, float grid_size, Surface_Mode surface_mode, int32 shell_layers, float shear_stiffness, float bend_stiffness);
+
+
+// Resting state of the solver chunks. A chunk is simulated while it or a chunk
+// its points have springs into still moved during the previous step, resting
+// chunks keep their state and are neither integrated nor written to the mesh.
+struct Sleep_State
+{
+    void reset()
+    {
+        chunk_points = 0;
+        num_points = 0;
+        still_steps.Reset();
+        adjacency_offsets.Reset();
+        adjacency_list.Reset();
+        chunk_moving.Reset();
+        chunk_awake.Reset();
+        chunk_synced.Reset();
+        chunk_render_dirty.Reset();
+    }
+    
+    int32 chunk_points = 0;
+    int32 num_points = 0;
+    
+    // consecutive steps each point stayed below the sleep threshold
+    TArray<uint8> still_steps;
+    
+    // CSR of the chunks each chunk has springs into, itself included
+    TArray<int32> adjacency_offsets;
+    TArray<int32> adjacency_list;
+    
+    // some point of the chunk moved during its last step
+    TArray<uint8> chunk_moving;
+    // chunk is simulated in the current step
+    TArray<uint8> chunk_awake;
+    // front and back buffers of a resting chunk hold the same state
+    TArray<uint8> chunk_synced;
+    // positions changed since the mesh was last written
+    TArray<uint8> chunk_render_dirty;
+    
+    SIZE_T allocated_size() const
+    {
+        return still_steps.GetAllocatedSize() + adjacency_offsets.GetAllocatedSize() + adjacency_list.GetAllocatedSize()
+            + chunk_moving.GetAllocatedSize() + chunk_awake.GetAllocatedSize() + chunk_synced.GetAllocatedSize()
+            + chunk_render_dirty.GetAllocatedSize();
+    }
+};
+
+// Topology of a lattice, shared by every body generated with the same
+// parameters and never written after generation. Per point adjacency
+// (neighbours and render vertices) is stored in compressed sparse row form: the
+// entries of point i are list[offsets[i] .. offsets[i + 1]).
+struct Lattice_Topology
+{
+    void reset()
+    {
+        rest.Reset();
+        side.Reset();
+        neighbour_offsets.Reset();
+        neighbour_list.Reset();
+        vertex_offsets.Reset();
+        vertex_list.Reset();
+        neighbour_spring.Reset();
+        point_stiffness.Reset();
+        spring_a.Reset();
+        spring_b.Reset();
+        spring_rest.Reset();
+        spring_stiffness.Reset();
+        spring_type.Reset();
+        spring_block_offsets.Reset();
+        axis_springs_only = true;
+    }
+    
+    int32 Num() const { return rest.Num(); }
+    int32 num_springs() const { return spring_a.Num(); }
+    int32 num_spring_blocks() const { return spring_block_offsets.Num() - 1; }
+    
+    // rest pose, spring rest offsets are rest[i] - rest[j]
+    TArray<FVector> rest;
+    // Cube_Side mask of the faces a point lies on
+    TArray<uint8> side;
+    
+    TArray<int32> neighbour_offsets;
+    TArray<int32> neighbour_list;
+    
+    TArray<int32> vertex_offsets;
+    TArray<int32> vertex_list;
+    
+    // spring of every neighbour_list entry, and the summed spring_stiffness per
+    // point, which also scales the damping drag of the point
+    TArray<int32> neighbour_spring;
+    TArray<float> point_stiffness;
+    
+    // Every spring once, from spring_a to spring_b, with its rest vector
+    // rest[a] - rest[b]. Springs are in the order of spring_a and cut into
+    // blocks of whole grid slices at least two deep, spring_block_offsets[i]
+    // .. [i + 1]. A spring reaches at most two slices ahead, so a block only
+    // shares points with its direct neighbours: all even blocks can run in
+    // parallel, then all odd ones.
+    TArray<int32> spring_a;
+    TArray<int32> spring_b;
+    TArray<FVector> spring_rest;
+    TArray<float> spring_stiffness;
+    TArray<uint8> spring_type;
+    TArray<int32> spring_block_offsets;
+    
+    // only axis aligned springs of stiffness 1, what the lattice stencil assumes
+    bool axis_springs_only = true;
+    
+    SIZE_T allocated_size() const
+    {
+        return rest.GetAllocatedSize() + side.GetAllocatedSize()
+            + neighbour_offsets.GetAllocatedSize() + neighbour_list.GetAllocatedSize()
+            + vertex_offsets.GetAllocatedSize() + vertex_list.GetAllocatedSize()
+            + neighbour_spring.GetAllocatedSize() + point_stiffness.GetAllocatedSize()
+            + spring_a.GetAllocatedSize() + spring_b.GetAllocatedSize() + spring_rest.GetAllocatedSize()
+            + spring_stiffness.GetAllocatedSize() + spring_type.GetAllocatedSize() + spring_block_offsets.GetAllocatedSize();
+    }
+};
+
+// State of one body. Mass points are kept as parallel arrays so the solver only
+// streams the data it actually touches each step, everything that follows from
+// the lattice alone is in the shared topology.
+struct Particle_Store
+{
+    void reset()
+    {
+        topology = nullptr;
+        pos.Reset();
+        vel.Reset();
+        inv_mass.Reset();
+        free_runs.Reset();
+        spring_stiffness.Reset();
+        spring_damping.Reset();
+        point_damping.Reset();
+        spring_rest.Reset();
+        torn_springs.Reset();
+        torn_weights.Reset();
+        pos_next.Reset();
+        vel_next.Reset();
+        force.Reset();
+        sleep.reset();
+        collision_grid.reset();
+        collision_delta.Reset();
+    };
+    
+    int32 Num() const { return pos.Num(); }
+    
+    // springs and points are weighted by a painted material
+    bool has_material() const { return spring_stiffness.Num() != 0; }
+    // stiffness and damping of every spring as a fraction of k and damping,
+    // and the summed damping of the springs of every point
+    const float * stiffness_weights() const { return has_material() ? spring_stiffness.GetData() : topology->spring_stiffness.GetData(); }
+    const float * damping_weights() const { return has_material() ? spring_damping.GetData() : topology->spring_stiffness.GetData(); }
+    const float * drag_weights() const { return has_material() ? point_damping.GetData() : topology->point_stiffness.GetData(); }
+    // rest offset pos[a] - pos[b] of every spring, the body's own once one yielded
+    const FVector * rest_offsets() const { return spring_rest.Num() ? spring_rest.GetData() : topology->spring_rest.GetData(); }
+    
+    // must outlive the store, set by init_particles
+    const Lattice_Topology * topology = nullptr;
+    
+    // hot, read and written every step
+    TArray<FVector> pos;
+    TArray<FVector> vel;
+    // zero for pinned points
+    TArray<float> inv_mass;
+    // [begin, end) pairs of the points that are not pinned, in order. Only
+    // these runs are integrated, pinned points are never visited
+    TArray<int32> free_runs;
+    
+    // painted material, empty while the body is uniform, see the weights above
+    TArray<float> spring_stiffness;
+    TArray<float> spring_damping;
+    TArray<float> point_damping;
+    // bumped by apply_material and torn springs, for anything derived from
+    // mass or material
+    uint32 material_version = 0;
+    
+    // plastic rest offsets, empty until a spring of the body yields
+    TArray<FVector> spring_rest;
+    // springs torn since generation, in the order they tore
+    TArray<int32> torn_springs;
+    // stiffness and damping weight of each torn spring before it tore, two
+    // per entry of torn_springs
+    TArray<float> torn_weights;
+    
+    // back buffers of pos / vel, swapped in at the end of every solver step
+    TArray<FVector> pos_next;
+    TArray<FVector> vel_next;
+    // scratch, written by the force pass
+    TArray<FVector> force;
+    
+    Sleep_State sleep;
+    
+    // scratch of the self collision pass, rebuilt every step
+    Dense_Grid collision_grid;
+    TArray<FVector> collision_delta;
+    
+    SIZE_T allocated_size() const
+    {
+        return pos.GetAllocatedSize() + vel.GetAllocatedSize() + inv_mass.GetAllocatedSize() + free_runs.GetAllocatedSize()
+            + spring_stiffness.GetAllocatedSize() + spring_damping.GetAllocatedSize() + point_damping.GetAllocatedSize()
+            + spring_rest.GetAllocatedSize() + torn_springs.GetAllocatedSize() + torn_weights.GetAllocatedSize()
+            + pos_next.GetAllocatedSize() + vel_next.GetAllocatedSize() + force.GetAllocatedSize()
+            + sleep.allocated_size() + collision_grid.allocated_size() + collision_delta.GetAllocatedSize();
+    }
+};
+
+// Render surface of the lattice, kept to recompute normals after deformation.
+// Shared like the Lattice_Topology.
+// The triangles around vertex v are triangle_list[triangle_offsets[v] .. triangle_offsets[v + 1]),
+// given as the first index of the triangle in Mesh_Section::triangles.
+struct Surface_Topology
+{
+    void reset()
+    {
+        vertex_point.Reset();
+        rest_normal.Reset();
+        rest_tangent.Reset();
+        uv.Reset();
+        triangle_offsets.Reset();
+        triangle_list.Reset();
+    }
+    
+    int32 Num() const { return vertex_point.Num(); }
+    
+    // owning mass point of every render vertex
+    TArray<int32> vertex_point;
+    // static streams at generation, the tangent is re-orthogonalised against
+    // the deformed normal
+    TArray<FVector> rest_normal;
+    TArray<FVector> rest_tangent;
+    TArray<FVector2D> uv;
+    
+    TArray<int32> triangle_offsets;
+    TArray<int32> triangle_list;
+    
+    SIZE_T allocated_size() const
+    {
+        return vertex_point.GetAllocatedSize() + rest_normal.GetAllocatedSize() + rest_tangent.GetAllocatedSize()
+            + uv.GetAllocatedSize() + triangle_offsets.GetAllocatedSize() + triangle_list.GetAllocatedSize();
+    }
+};
+
+struct Mesh_Section
+{
+    void reset()
+    {
+        size = FVector(0, 0, 0);
+        vertices.Reset();
+        triangles.Reset();
+        lattice.reset();
+        surface.reset();
+    };
+    
+     FVector size;
+    TArray<FVector> vertices;
+    TArray<int32> triangles;
+    Lattice_Topology lattice;
+    Surface_Topology surface;
+    
+    SIZE_T allocated_size() const
+    {
+        return vertices.GetAllocatedSize() + triangles.GetAllocatedSize() + lattice.allocated_size() + surface.allocated_size();
+    }
+};
+
+
+// Exact element counts of the lattice of a key.
+struct Lattice_Counts
+{
+    int32 points;
+    // neighbour_list entries, twice the springs
+    int32 neighbours;
+    int32 vertices;
+    int32 indices;
+};
+
+int32 calc(const FIntVector & index, const FIntVector & size);
+
+// Hollow lattices only simulate the points less than shell_layers steps from
+// the surface, 0 keeps the full volume.
+bool in_shell(const FIntVector & index, const FIntVector & size, int32 shell_layers);
+
+// Writes the points index has springs to and their stiffness, returns how
+// many. Axis neighbours always, face diagonals and two step neighbours when
+// the key gives them a stiffness, all within the shell. grid_point maps grid
+// cells to shell points, null for the full volume. A null result only counts.
+int32 get_links(const FIntVector & index, const Lattice_Key & key, const int32 * grid_point, int32 * result, float * stiffness);
+
+Lattice_Counts lattice_counts(const Lattice_Key & key);
+
+// Builds the lattice of key and its render surface. The static vertex streams
+// end up in mesh_section.vertices / triangles and the rest_* streams of the
+// surface, ready to be copied into a mesh section. Buffers of a previous
+// generation are reused.
+void generateMesh(Mesh_Section & meshSection, const Lattice_Key & key);
+
+// Material painted onto the points on any of the Cube_Side bits of side_mask,
+// and onto the points whose rest position lies in [box_min, box_max] when
+// use_box is set. Springs take the mean of the scales at their two ends.
+struct Material_Paint
+{
+    uint8 side_mask = CubeSide_None;
+    bool use_box = false;
+    FVector box_min;
+    FVector box_max;
+    
+    float mass_scale = 1.0f;
+    float stiffness_scale = 1.0f;
+    float damping_scale = 1.0f;
+    // pinned points never move, whatever their springs and inputs do
+    bool pinned = false;
+};
+
+// Sets points up as a body of the lattice at rest, with every point of the given mass.
+void init_particles(Particle_Store & points, const Lattice_Topology & lattice, float mass);
+
+// Parameter only changes that keep the topology: mass per point, then the
+// paints in order, later ones overriding the scales of earlier ones.
+void apply_material(Particle_Store & points, float mass, const TArray<Material_Paint> & paints);
+// back to the rest pose at zero velocity, all points awake
+void reset_to_rest(Particle_Store & points);
@@ -0,0 +1,268 @@
+#include "ImplicitSolver.h"
+#include "MSDStats.h"
+
+// squared residual per point below which the solve counts as converged
+#define CG_MIN_RESIDUAL 1e-12f
+
+
+static FVector safe_divide(const FVector & a, const FVector & b)
+{
+    return FVector(b.X != 0.0f ? a.X / b.X : 0.0f,
+                   b.Y != 0.0f ? a.Y / b.Y : 0.0f,
+                   b.Z != 0.0f ? a.Z / b.Z : 0.0f);
+}
+
+// chunk partial sums are added in chunk order so the result does not depend on scheduling
+static FVector sum_partials(const TArray<FVector> & partial)
+{
+    FVector sum(0, 0, 0);
+    for (const FVector & value : partial)
+    {
+        sum += value;
+    }
+    return sum;
+}
+
+void Implicit_Euler_Integrator::update_matrix(const Particle_Store & points, const Solver_Params & params)
+{
+    const Lattice_Topology & topology = *points.topology;
+    const int32 count = points.Num();
+    if (matrix_dt == params.dt && matrix_k == params.k && matrix_damping == params.damping &&
+        matrix_pattern == topology.neighbour_list.GetData() && matrix_points == count && matrix_material == points.material_version)
+    {
+        return;
+    }
+    
+    const float dt = params.dt;
+    const float stiffness = dt * dt * params.k;
+    const float damping = dt * params.damping;
+    
+    diag.SetNumUninitialized(count);
+    inv_diag.SetNumUninitialized(count);
+    off_diag.SetNumUninitialized(topology.neighbour_list.Num());
+    
+    const float * stiffness_weights = points.stiffness_weights();
+    const float * drag_weights = points.drag_weights();
+    const float * inv_mass = points.inv_mass.GetData();
+    
+    for (int32 idx = 0; idx < count; ++idx)
+    {
+        const int32 begin = topology.neighbour_offsets[idx];
+        const int32 end = topology.neighbour_offsets[idx + 1];
+        
+        if (inv_mass[idx] == 0.0f)
+        {
+            // pinned: an identity row against a zero right hand side keeps v at 0
+            diag[idx] = 1.0f;
+            inv_diag[idx] = 1.0f;
+            for (int32 i = begin; i < end; ++i)
+            {
+                off_diag[i] = 0.0f;
+            }
+            continue;
+        }
+        
+        float point_stiffness = 0.0f;
+        for (int32 i = begin; i < end; ++i)
+        {
+            const float weight = stiffness_weights[topology.neighbour_spring[i]];
+            point_stiffness += weight;
+            // the column of a pinned point is dropped as well, its v is 0 and the matrix stays symmetric
+            off_diag[i] = inv_mass[topology.neighbour_list[i]] == 0.0f ? 0.0f : -stiffness * weight;
+        }
+        diag[idx] = (1.0f / inv_mass[idx]) + damping * drag_weights[idx] + stiffness * point_stiffness;
+        inv_diag[idx] = 1.0f / diag[idx];
+    }
+    
+    matrix_dt = params.dt;
+    matrix_k = params.k;
+    matrix_damping = params.damping;
+    matrix_pattern = topology.neighbour_list.GetData();
+    matrix_points = count;
+    matrix_material = points.material_version;
+}
+
+void Implicit_Euler_Integrator::multiply(const Particle_Store & points, const FVector * x, FVector * result, int32 begin, int32 end) const
+{
+    const int32 * neighbour_offsets = points.topology->neighbour_offsets.GetData();
+    const int32 * neighbour_list = points.topology->neighbour_list.GetData();
+    
+    for (int32 idx = begin; idx < end; ++idx)
+    {
+        FVector value = x[idx] * diag[idx];
+        for (int32 i = neighbour_offsets[idx]; i < neighbour_offsets[idx + 1]; ++i)
+        {
+            value += x[neighbour_list[i]] * off_diag[i];
+        }
+        result[idx] = value;
+    }
+}
+
+void Implicit_Euler_Integrator::step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    const int32 count = points.Num();
+    const float dt = params.dt;
+    const int32 chunk_points = solver_chunk_points(points, stencil, params);
+    const int32 num_chunks = FMath::DivideAndRoundUp(count, chunk_points);
+    
+    update_matrix(points, params);
+    
+    points.force.SetNumUninitialized(count);
+    points.pos_next.SetNumUninitialized(count);
+    points.vel_next.SetNumUninitialized(count);
+    
+    // the linear solve couples every point, so the lattice only sleeps as a whole
+    solver_prepare_sleep(points, chunk_points, params.sleep);
+    Sleep_State & sleep = points.sleep;
+    const bool awake = sleep.chunk_awake.Contains(true);
+    for (uint8 & chunk_awake : sleep.chunk_awake)
+    {
+        chunk_awake = awake;
+    }
+    if (!awake)
+    {
+        solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+        {
+            solver_skip_resting_chunk(points, begin, end);
+        });
+        Swap(points.pos, points.pos_next);
+        Swap(points.vel, points.vel_next);
+        return;
+    }
+
+    rhs.SetNumUninitialized(count);
+    residual.SetNumUninitialized(count);
+    search.SetNumUninitialized(count);
+    product.SetNumUninitialized(count);
+    partial.SetNumUninitialized(num_chunks);
+    partial_rr.SetNumUninitialized(num_chunks);
+    
+    const FVector * pos = points.pos.GetData();
+    const FVector * vel = points.vel.GetData();
+    const float * inv_mass = points.inv_mass.GetData();
+    FVector * force = points.force.GetData();
+    FVector * v = points.vel_next.GetData();
+    FVector * b = rhs.GetData();
+    FVector * r = residual.GetData();
+    FVector * p = search.GetData();
+    FVector * Ap = product.GetData();
+    
+    // spring force only, damping is part of the matrix
+    solver_forces(points, stencil, params, pos, vel, 0.0f, force);
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_LinearSolve);
+    
+    // b = M v + dt f, warm start from the current velocity. Pinned points stay at 0
+    solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        FMemory::Memzero(b + begin, (end - begin) * sizeof(FVector));
+        FMemory::Memzero(v + begin, (end - begin) * sizeof(FVector));
+        solver_free_runs(points, begin, end, [&](int32 run_begin, int32 run_end)
+        {
+            for (int32 idx = run_begin; idx < run_end; ++idx)
+            {
+                b[idx] = vel[idx] * (1.0f / inv_mass[idx]) + force[idx] * dt;
+                v[idx] = vel[idx];
+            }
+        });
+    });
+    
+    // r = b - A v, z = D^-1 r, p = z
+    solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        multiply(points, v, Ap, begin, end);
+        FVector rz(0, 0, 0);
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            r[idx] = b[idx] - Ap[idx];
+            p[idx] = r[idx] * inv_diag[idx];
+            rz += r[idx] * p[idx];
+        }
+        partial[begin / chunk_points] = rz;
+    });
+    FVector rz = sum_partials(partial);
+    
+    solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        FVector bb(0, 0, 0);
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            bb += b[idx] * b[idx];
+        }
+        partial[begin / chunk_points] = bb;
+    });
+    // relative to the right hand side, with an absolute floor so nearly resting
+    // lattices do not iterate on denormal noise
+    const float threshold = FMath::Max(params.cg_tolerance * params.cg_tolerance * sum_partials(partial).GetMax(), CG_MIN_RESIDUAL * count);
+    
+    iterations = 0;
+    while (iterations < params.cg_max_iterations)
+    {
+        ++iterations;
+        
+        solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+        {
+            multiply(points, p, Ap, begin, end);
+            FVector pAp(0, 0, 0);
+            for (int32 idx = begin; idx < end; ++idx)
+            {
+                pAp += p[idx] * Ap[idx];
+            }
+            partial[begin / chunk_points] = pAp;
+        });
+        const FVector alpha = safe_divide(rz, sum_partials(partial));
+        
+        // the preconditioned residual z is only needed for its dot product here,
+        // p is rebuilt from it in the next pass
+        solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+        {
+            FVector rz_chunk(0, 0, 0);
+            FVector rr_chunk(0, 0, 0);
+            for (int32 idx = begin; idx < end; ++idx)
+            {
+                v[idx] += alpha * p[idx];
+                r[idx] -= alpha * Ap[idx];
+                rz_chunk += r[idx] * (r[idx] * inv_diag[idx]);
+                rr_chunk += r[idx] * r[idx];
+            }
+            partial[begin / chunk_points] = rz_chunk;
+            partial_rr[begin / chunk_points] = rr_chunk;
+        });
+        const FVector rz_new = sum_partials(partial);
+        
+        if (sum_partials(partial_rr).GetMax() <= threshold)
+        {
+            break;
+        }
+        
+        const FVector beta = safe_divide(rz_new, rz);
+        rz = rz_new;
+        
+        solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+        {
+            for (int32 idx = begin; idx < end; ++idx)
+            {
+                p[idx] = r[idx] * inv_diag[idx] + beta * p[idx];
+            }
+        });
+    }
+    
+    FVector * pos_next = points.pos_next.GetData();
+    solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        // every chunk is awake here, this only flags it as changed
+        solver_skip_resting_chunk(points, begin, end);
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            pos_next[idx] = pos[idx] + v[idx] * dt;
+        }
+        
+        if (params.sleep)
+        {
+            solver_update_resting(points, params, begin, end);
+        }
+    });
+    
+    Swap(points.pos, points.pos_next);
+    Swap(points.vel, points.vel_next);
+}
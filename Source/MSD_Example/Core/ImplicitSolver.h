@@ -0,0 +1,59 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Solver.h"
+
+// Backward Euler step for the linear spring lattice.
+//
+// With f(x, v) = -k L x + k rest_sum - c D v (L the lattice Laplacian weighted
+// by spring stiffness, D the summed spring stiffness per point) the step solves
+//
+//   (M + dt c D + dt^2 k L) v' = M v + dt f_spring(x),   x' = x + dt v'
+//
+// by Jacobi preconditioned conjugate gradient. The matrix is the same for the
+// x, y and z components, so the three systems are solved side by side. Its
+// sparsity pattern is the neighbour CSR of the store, only the values are
+// cached here and they are refilled when dt, k, damping, the lattice or the
+// material change. Pinned points get identity rows and zero velocity.
+class Implicit_Euler_Integrator : public Integrator
+{
+public:
+    virtual Integrator_Type type() const override { return IntegratorType_ImplicitEuler; }
+    virtual void step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params) override;
+    virtual void reset() override { matrix_points = 0; }
+    virtual SIZE_T allocated_size() const override
+    {
+        return diag.GetAllocatedSize() + inv_diag.GetAllocatedSize() + off_diag.GetAllocatedSize()
+            + rhs.GetAllocatedSize() + residual.GetAllocatedSize() + search.GetAllocatedSize()
+            + product.GetAllocatedSize() + partial.GetAllocatedSize() + partial_rr.GetAllocatedSize();
+    }
+    
+    // iterations the last step needed
+    int32 last_iterations() const { return iterations; }
+    
+private:
+    void update_matrix(const Particle_Store & points, const Solver_Params & params);
+    void multiply(const Particle_Store & points, const FVector * x, FVector * result, int32 begin, int32 end) const;
+    
+    // matrix values, off_diag is aligned with topology.neighbour_list
+    TArray<float> diag;
+    TArray<float> inv_diag;
+    TArray<float> off_diag;
+    
+    float matrix_dt = 0.0f;
+    float matrix_k = 0.0f;
+    float matrix_damping = 0.0f;
+    const int32 * matrix_pattern = nullptr;
+    int32 matrix_points = 0;
+    uint32 matrix_material = 0;
+    
+    // conjugate gradient work vectors
+    TArray<FVector> rhs;
+    TArray<FVector> residual;
+    TArray<FVector> search;
+    TArray<FVector> product;
+    TArray<FVector> partial;
+    TArray<FVector> partial_rr;
+    
+    int32 iterations = 0;
+};
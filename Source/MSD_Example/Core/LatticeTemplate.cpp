@@ -0,0 +1,123 @@
+#include "LatticeTemplate.h"
+#include "MSDStats.h"
+
+
+struct Lattice_Cache_Entry
+{
+    Lattice_Key key;
+    TWeakPtr<const Lattice_Template, ESPMode::ThreadSafe> lattice;
+};
+
+// a handful of distinct lattices at most, a linear search is all it takes
+static TArray<Lattice_Cache_Entry> & lattice_cache()
+{
+    static TArray<Lattice_Cache_Entry> entries;
+    return entries;
+}
+
+// forgets the templates whose last reference is gone
+static void lattice_cache_prune()
+{
+    TArray<Lattice_Cache_Entry> & entries = lattice_cache();
+    for (int32 i = entries.Num() - 1; i >= 0; --i)
+    {
+        if (!entries[i].lattice.IsValid())
+        {
+            entries.RemoveAtSwap(i);
+        }
+    }
+}
+
+
+static Lattice_Template_Ref lattice_cache_find(const Lattice_Key & key)
+{
+    lattice_cache_prune();
+    for (const Lattice_Cache_Entry & entry : lattice_cache())
+    {
+        if (entry.key == key)
+        {
+            return entry.lattice.Pin();
+        }
+    }
+    return nullptr;
+}
+
+// builds the stencil of a filled template and makes it known
+static Lattice_Template_Ref lattice_cache_add(const TSharedPtr<Lattice_Template, ESPMode::ThreadSafe> & lattice)
+{
+    build_stencil(lattice->stencil, lattice->mesh.lattice, lattice->mesh.size);
+
+    Lattice_Cache_Entry entry;
+    entry.key = lattice->key;
+    entry.lattice = lattice;
+    lattice_cache().Add(entry);
+    return lattice;
+}
+
+
+Lattice_Template_Ref lattice_cache_acquire(const Lattice_Key & key)
+{
+    Lattice_Template_Ref previous;
+    return lattice_cache_acquire(key, previous);
+}
+
+Lattice_Template_Ref lattice_cache_acquire(const Lattice_Key & key, Lattice_Template_Ref & previous)
+{
+    Lattice_Template_Ref lattice = lattice_cache_find(key);
+    if (lattice.IsValid())
+    {
+        previous.Reset();
+        return lattice;
+    }
+
+    MSD_SCOPE_CYCLE(STAT_MSD_BuildLattice);
+    TSharedPtr<Lattice_Template, ESPMode::ThreadSafe> built = MakeShared<Lattice_Template, ESPMode::ThreadSafe>();
+    if (previous.IsValid() && previous.GetSharedReferenceCount() == 1)
+    {
+        // no other body or step reads the old template any more, generateMesh
+        // and build_stencil refill its buffers without freeing them
+        Lattice_Template & old = const_cast<Lattice_Template &>(*previous);
+        built->mesh = MoveTemp(old.mesh);
+        built->stencil = MoveTemp(old.stencil);
+    }
+    previous.Reset();
+
+    built->key = key;
+    generateMesh(built->mesh, key);
+    return lattice_cache_add(built);
+}
+
+Lattice_Template_Ref lattice_cache_adopt(const Lattice_Key & key, Mesh_Section && mesh)
+{
+    Lattice_Template_Ref lattice = lattice_cache_find(key);
+    if (lattice.IsValid())
+    {
+        return lattice;
+    }
+
+    MSD_SCOPE_CYCLE(STAT_MSD_BuildLattice);
+    TSharedPtr<Lattice_Template, ESPMode::ThreadSafe> built = MakeShared<Lattice_Template, ESPMode::ThreadSafe>();
+    built->key = key;
+    built->mesh = MoveTemp(mesh);
+    return lattice_cache_add(built);
+}
+
+int32 lattice_cache_num()
+{
+    lattice_cache_prune();
+    return lattice_cache().Num();
+}
+
+SIZE_T lattice_cache_allocated_size()
+{
+    SIZE_T size = 0;
+    for (const Lattice_Cache_Entry & entry : lattice_cache())
+    {
+        Lattice_Template_Ref lattice = entry.lattice.Pin();
+        if (lattice.IsValid())
+        {
+            size += lattice->allocated_size();
+        }
+    }
+    return size;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+#include "SpringKernel.h"
+
+// Everything about a body that only follows from its Lattice_Key: topology,
+// render surface and spring stencil. Built once and then only read, by any
+// number of bodies and their background steps at the same time.
+struct Lattice_Template
+{
+    Lattice_Key key;
+    Mesh_Section mesh;
+    Lattice_Stencil stencil;
+
+    SIZE_T allocated_size() const { return mesh.allocated_size() + stencil.allocated_size(); }
+};
+
+typedef TSharedPtr<const Lattice_Template, ESPMode::ThreadSafe> Lattice_Template_Ref;
+
+// Template of key, shared with every other live reference to it, generated
+// when none is alive. Templates are freed with their last reference. Not
+// thread safe, bodies acquire their templates on the game thread.
+Lattice_Template_Ref lattice_cache_acquire(const Lattice_Key & key);
+// same, releasing previous, the caller's template of an earlier key. When the
+// caller held its last reference, a template that has to be generated takes
+// over its buffers instead of allocating new ones.
+Lattice_Template_Ref lattice_cache_acquire(const Lattice_Key & key, Lattice_Template_Ref & previous);
+// Template of key around mesh, which holds the generateMesh output of key,
+// for lattices loaded rather than generated. A live template of key wins and
+// mesh is dropped.
+Lattice_Template_Ref lattice_cache_adopt(const Lattice_Key & key, Mesh_Section && mesh);
+
+// live templates and the memory they hold
+int32 lattice_cache_num();
+SIZE_T lattice_cache_allocated_size();
@@ -0,0 +1,15 @@
+#pragma once
+
+// Everything under Core/ is the engine independent part of the simulation:
+// lattice generation, spring kernels, integrators, surface and spatial index.
+// It uses the engine's container and math types and no UObjects, so besides the
+// game module it also builds standalone (MSD_STANDALONE, see Tools/MSDBench),
+// where MSDStandalone.h provides std based stand-ins for the few engine types
+// and the ParallelFor the core relies on.
+
+#if defined(MSD_STANDALONE) && MSD_STANDALONE
+    #include "MSDStandalone.h"
+#else
+    #include "CoreMinimal.h"
+    #include "Async/ParallelFor.h"
+#endif
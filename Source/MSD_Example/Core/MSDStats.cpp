@@ -0,0 +1,38 @@
+#include "MSDStats.h"
+
+#if !(defined(MSD_STANDALONE) && MSD_STANDALONE)
+
+DEFINE_STAT(STAT_MSD_Generate);
+DEFINE_STAT(STAT_MSD_BuildLattice);
+DEFINE_STAT(STAT_MSD_Step);
+DEFINE_STAT(STAT_MSD_Forces);
+DEFINE_STAT(STAT_MSD_Integrate);
+DEFINE_STAT(STAT_MSD_LinearSolve);
+DEFINE_STAT(STAT_MSD_Interpolate);
+DEFINE_STAT(STAT_MSD_WriteVertices);
+DEFINE_STAT(STAT_MSD_Normals);
+DEFINE_STAT(STAT_MSD_Commit);
+DEFINE_STAT(STAT_MSD_SpatialQuery);
+DEFINE_STAT(STAT_MSD_SpatialRefit);
+DEFINE_STAT(STAT_MSD_Schedule);
+DEFINE_STAT(STAT_MSD_BatchStep);
+DEFINE_STAT(STAT_MSD_Collision);
+DEFINE_STAT(STAT_MSD_BroadPhase);
+DEFINE_STAT(STAT_MSD_GatherShapes);
+DEFINE_STAT(STAT_MSD_ProxyRefit);
+DEFINE_STAT(STAT_MSD_Record);
+DEFINE_STAT(STAT_MSD_Keyframe);
+DEFINE_STAT(STAT_MSD_Plasticity);
+
+DEFINE_STAT(STAT_MSD_TotalPoints);
+DEFINE_STAT(STAT_MSD_ActivePoints);
+DEFINE_STAT(STAT_MSD_SleepingPoints);
+DEFINE_STAT(STAT_MSD_Contacts);
+DEFINE_STAT(STAT_MSD_ProxyCooks);
+DEFINE_STAT(STAT_MSD_KeyframeBytes);
+DEFINE_STAT(STAT_MSD_TornSprings);
+DEFINE_STAT(STAT_MSD_Bodies);
+DEFINE_STAT(STAT_MSD_SleepingBodies);
+DEFINE_STAT(STAT_MSD_StarvedBodies);
+
+#endif
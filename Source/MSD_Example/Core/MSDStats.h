@@ -0,0 +1,67 @@
+#pragma once
+
+#include "MSDCore.h"
+
+// Stat group of the MSD pipeline, "stat MSD" in the console. Every scope also
+// shows up as a CPU event in Unreal Insights on engines that have the
+// trace macros. The standalone build compiles all of it away.
+//
+//   MSD_SCOPE_CYCLE(Stat)         cycle counter plus trace scope
+//   MSD_ADD_COUNTER(Stat, Value)  per frame counter, summed over all actors
+
+#if defined(MSD_STANDALONE) && MSD_STANDALONE
+
+#define MSD_SCOPE_CYCLE(Stat)
+#define MSD_ADD_COUNTER(Stat, Value)
+
+#else
+
+#include "Stats/Stats.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+#if ENGINE_MAJOR_VERSION > 4 || (ENGINE_MAJOR_VERSION == 4 && ENGINE_MINOR_VERSION >= 25)
+    #include "ProfilingDebugging/CpuProfilerTrace.h"
+    #define MSD_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE(Name)
+#else
+    #define MSD_TRACE_SCOPE(Name)
+#endif
+
+#define MSD_SCOPE_CYCLE(Stat) SCOPE_CYCLE_COUNTER(Stat); MSD_TRACE_SCOPE(Stat)
+#define MSD_ADD_COUNTER(Stat, Value) INC_DWORD_STAT_BY(Stat, Value)
+
+DECLARE_STATS_GROUP(TEXT("MSD"), STATGROUP_MSD, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Generate"), STAT_MSD_Generate, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Build Lattice Template"), STAT_MSD_BuildLattice, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Solver Step"), STAT_MSD_Step, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Force Accumulation"), STAT_MSD_Forces, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Integration"), STAT_MSD_Integrate, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Implicit Linear Solve"), STAT_MSD_LinearSolve, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Interpolation"), STAT_MSD_Interpolate, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Vertex Write-back"), STAT_MSD_WriteVertices, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Normal Recompute"), STAT_MSD_Normals, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Section Commit"), STAT_MSD_Commit, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Spatial Query"), STAT_MSD_SpatialQuery, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Spatial Refit"), STAT_MSD_SpatialRefit, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Body Schedule"), STAT_MSD_Schedule, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Collision"), STAT_MSD_Collision, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Self Collision Broad Phase"), STAT_MSD_BroadPhase, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Gather World Shapes"), STAT_MSD_GatherShapes, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Collision Proxy Refit"), STAT_MSD_ProxyRefit, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Record Step"), STAT_MSD_Record, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Write Keyframe"), STAT_MSD_Keyframe, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Yield and Tearing"), STAT_MSD_Plasticity, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Batch Step"), STAT_MSD_BatchStep, STATGROUP_MSD, MSD_EXAMPLE_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Total Points"), STAT_MSD_TotalPoints, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active Points"), STAT_MSD_ActivePoints, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sleeping Points"), STAT_MSD_SleepingPoints, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Contacts"), STAT_MSD_Contacts, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Collision Proxy Cooks"), STAT_MSD_ProxyCooks, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Keyframe Bytes"), STAT_MSD_KeyframeBytes, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Torn Springs"), STAT_MSD_TornSprings, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bodies"), STAT_MSD_Bodies, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sleeping Bodies"), STAT_MSD_SleepingBodies, STATGROUP_MSD, MSD_EXAMPLE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Over Budget Bodies"), STAT_MSD_StarvedBodies, STATGROUP_MSD, MSD_EXAMPLE_API);
+
+#endif
@@ -0,0 +1,225 @@
+#include "Plasticity.h"
+#include "MSDStats.h"
+
+// Copies the topology's weights and rest offsets into the store the first
+// time one spring of the body differs from the others.
+static void own_spring_state(Particle_Store & points)
+{
+    const Lattice_Topology & topology = *points.topology;
+    if (!points.has_material())
+    {
+        points.spring_stiffness = topology.spring_stiffness;
+        points.spring_damping = topology.spring_stiffness;
+        points.point_damping = topology.point_stiffness;
+        ++points.material_version;
+    }
+    if (points.spring_rest.Num() != topology.num_springs())
+    {
+        points.spring_rest = topology.spring_rest;
+    }
+}
+
+// zeroes the weights of spring s and appends what they were to weights, the
+// caller owns the spring state
+static void tear_spring(Particle_Store & points, int32 s, TArray<float> & weights)
+{
+    weights.Add(points.spring_stiffness[s]);
+    weights.Add(points.spring_damping[s]);
+    
+    // the drag of a point is the sum of the damping of its springs
+    const Lattice_Topology & topology = *points.topology;
+    const float damping = points.spring_damping[s];
+    points.point_damping[topology.spring_a[s]] -= damping;
+    points.point_damping[topology.spring_b[s]] -= damping;
+    points.spring_stiffness[s] = 0.0f;
+    points.spring_damping[s] = 0.0f;
+}
+
+bool plastic_tear(Particle_Store & points, int32 s)
+{
+    own_spring_state(points);
+    if (plastic_is_torn(points, s))
+    {
+        return false;
+    }
+    
+    tear_spring(points, s, points.torn_weights);
+    ++points.material_version;
+    points.torn_springs.Add(s);
+    return true;
+}
+
+// the drag of point idx summed over its springs like apply_material does, so
+// the value is bit identical to the one before any spring of it tore
+static void sum_point_damping(Particle_Store & points, int32 idx)
+{
+    const Lattice_Topology & topology = *points.topology;
+    float sum = 0.0f;
+    for (int32 n = topology.neighbour_offsets[idx]; n < topology.neighbour_offsets[idx + 1]; ++n)
+    {
+        sum += points.spring_damping[topology.neighbour_spring[n]];
+    }
+    points.point_damping[idx] = sum;
+}
+
+void plastic_heal(Particle_Store & points)
+{
+    const Lattice_Topology & topology = *points.topology;
+    const int32 num_torn = points.torn_springs.Num();
+    for (int32 i = 0; i < num_torn; ++i)
+    {
+        const int32 s = points.torn_springs[i];
+        points.spring_stiffness[s] = points.torn_weights[2 * i];
+        points.spring_damping[s] = points.torn_weights[2 * i + 1];
+    }
+    for (int32 s : points.torn_springs)
+    {
+        sum_point_damping(points, topology.spring_a[s]);
+        sum_point_damping(points, topology.spring_b[s]);
+    }
+    if (num_torn)
+    {
+        ++points.material_version;
+    }
+    points.torn_springs.Reset();
+    points.torn_weights.Reset();
+    points.spring_rest.Reset();
+}
+
+void plastic_restore(Particle_Store & points, const TArray<int32> & torn, const TArray<FVector> & rest_offsets)
+{
+    plastic_heal(points);
+    if (rest_offsets.Num() == points.topology->num_springs())
+    {
+        own_spring_state(points);
+        points.spring_rest = rest_offsets;
+    }
+    for (int32 s : torn)
+    {
+        plastic_tear(points, s);
+    }
+}
+
+int32 plastic_update(Particle_Store & points, const Plastic_Params & params, float dt, bool multithreaded)
+{
+    if (!params.is_enabled())
+    {
+        return 0;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_Plasticity);
+    const Lattice_Topology & topology = *points.topology;
+    const Sleep_State & sleep = points.sleep;
+    const bool tracked = sleep.num_points == points.Num();
+    const bool all_awake = !tracked || !sleep.chunk_awake.Contains(0);
+    const int32 num_blocks = topology.num_spring_blocks();
+    const FVector * pos = points.pos.GetData();
+    const float creep = FMath::Clamp(params.creep_rate * dt, 0.0f, 1.0f);
+    // without creep yielding changes nothing
+    const float yield_strain = params.yield_strain > 0.0f && creep > 0.0f ? params.yield_strain : MAX_flt;
+    const float break_strain = params.break_strain > 0.0f ? params.break_strain : MAX_flt;
+    const float limit_strain = FMath::Min(yield_strain, break_strain);
+    
+    // the strain of spring s beyond limit_strain, as the squares of its
+    // deviation from rest and its generation length, false within it
+    auto strained = [&](int32 s, FVector & deviation, float & deviation_sq, float & length_sq)
+    {
+        const int32 a = topology.spring_a[s];
+        const int32 b = topology.spring_b[s];
+        if (!all_awake && !sleep.chunk_awake[a / sleep.chunk_points] && !sleep.chunk_awake[b / sleep.chunk_points])
+        {
+            return false;
+        }
+        if (plastic_is_torn(points, s))
+        {
+            return false;
+        }
+        
+        deviation = pos[a] - pos[b] - points.rest_offsets()[s];
+        deviation_sq = deviation.SizeSquared();
+        length_sq = topology.spring_rest[s].SizeSquared();
+        return deviation_sq > limit_strain * limit_strain * length_sq;
+    };
+    
+    if (points.spring_rest.Num() != topology.num_springs() || !points.has_material())
+    {
+        // nothing of the body yielded or tore so far, it keeps sharing the
+        // topology's spring state until a spring goes past its limit
+        TArray<uint8> block_strained;
+        block_strained.SetNumZeroed(num_blocks);
+        ParallelFor(num_blocks, [&](int32 block)
+        {
+            FVector deviation;
+            float deviation_sq, length_sq;
+            const int32 end = topology.spring_block_offsets[block + 1];
+            for (int32 s = topology.spring_block_offsets[block]; s < end && !block_strained[block]; ++s)
+            {
+                block_strained[block] = strained(s, deviation, deviation_sq, length_sq);
+            }
+        }, !multithreaded);
+        if (!block_strained.Contains(1))
+        {
+            return 0;
+        }
+        own_spring_state(points);
+    }
+    
+    // a tear changes the drag of both ends, so blocks run even ones first,
+    // then odd ones, like the spring forces. Torn springs are collected per
+    // block, whatever the number of workers
+    TArray<TArray<int32>> block_torn;
+    TArray<TArray<float>> block_weights;
+    block_torn.SetNum(num_blocks);
+    block_weights.SetNum(num_blocks);
+    for (int32 parity = 0; parity < 2; ++parity)
+    {
+        ParallelFor((num_blocks + 1 - parity) / 2, [&](int32 i)
+        {
+            const int32 block = 2 * i + parity;
+            TArray<int32> & torn = block_torn[block];
+            TArray<float> & weights = block_weights[block];
+            FVector deviation;
+            float deviation_sq, length_sq;
+            const int32 end = topology.spring_block_offsets[block + 1];
+            for (int32 s = topology.spring_block_offsets[block]; s < end; ++s)
+            {
+                if (!strained(s, deviation, deviation_sq, length_sq))
+                {
+                    continue;
+                }
+                
+                if (deviation_sq > break_strain * break_strain * length_sq)
+                {
+                    tear_spring(points, s, weights);
+                    torn.Add(s);
+                }
+                else if (deviation_sq > yield_strain * yield_strain * length_sq)
+                {
+                    // only the part beyond the yield strain flows
+                    const float excess = 1.0f - yield_strain * FMath::Sqrt(length_sq / deviation_sq);
+                    points.spring_rest[s] += deviation * (excess * creep);
+                }
+            }
+        }, !multithreaded);
+    }
+    
+    // in the order the drag of each point changed, restoring a body tears
+    // them again in that order
+    int32 torn = 0;
+    for (int32 parity = 0; parity < 2; ++parity)
+    {
+        for (int32 block = parity; block < num_blocks; block += 2)
+        {
+            points.torn_springs.Append(block_torn[block]);
+            points.torn_weights.Append(block_weights[block]);
+            torn += block_torn[block].Num();
+        }
+    }
+    if (torn)
+    {
+        ++points.material_version;
+    }
+    
+    MSD_ADD_COUNTER(STAT_MSD_TornSprings, torn);
+    return torn;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+
+// Permanent deformation of one body. A spring stretched or compressed beyond
+// its yield strain slowly takes its current shape as its new rest offset, one
+// strained beyond its break strain tears. Both only touch the body's own
+// copies of the spring state in its Particle_Store, the shared topology never
+// changes and a torn spring costs O(1): its weights drop to zero, which every
+// force path and the self collision read as "no spring".
+//
+// Strain is the distance of a spring from its rest offset over its generation
+// length. The body leaves the lattice stencil the first time a spring yields
+// or tears, the stencil cannot weight single springs.
+struct Plastic_Params
+{
+    // strain a spring holds elastically, 0 for no yield
+    float yield_strain = 0.0f;
+    // share of the strain beyond yield_strain a spring takes as rest per second
+    float creep_rate = 0.0f;
+    // strain that tears a spring, 0 for none
+    float break_strain = 0.0f;
+    
+    // yield without creep never moves a rest offset
+    bool is_enabled() const { return (yield_strain > 0.0f && creep_rate > 0.0f) || break_strain > 0.0f; }
+};
+
+// Yields and tears the springs with an end in an awake chunk after a step of
+// dt, in the spring blocks of the topology. Torn springs are appended to
+// points.torn_springs, even blocks first, then odd ones. Returns the number of
+// springs torn by this call.
+int32 plastic_update(Particle_Store & points, const Plastic_Params & params, float dt, bool multithreaded);
+
+// Tears spring s of points, no matter its strain. False when it was torn already.
+bool plastic_tear(Particle_Store & points, int32 s);
+
+// Gives every torn spring of points its weights back and every yielded one
+// its generation rest offset.
+void plastic_heal(Particle_Store & points);
+
+// Heals points, then takes rest_offsets as the rest of every spring unless it
+// is empty and tears the springs of torn in order. Restoring the torn_springs
+// and spring_rest of a body gives the body's exact weights back.
+void plastic_restore(Particle_Store & points, const TArray<int32> & torn, const TArray<FVector> & rest_offsets);
+
+// Whether spring s of points is gone.
+inline bool plastic_is_torn(const Particle_Store & points, int32 s)
+{
+    return points.has_material() && points.spring_stiffness[s] == 0.0f && points.spring_damping[s] == 0.0f;
+}
@@ -0,0 +1,129 @@
+#include "Scheduler.h"
+
+// weight of the newest measurement in the cost estimate
+#define SCHEDULE_COST_SMOOTHING 0.1
+
+int32 body_lod_interval(Body_Lod lod)
+{
+    switch (lod)
+    {
+        case BodyLod_Full:
+            return 1;
+        case BodyLod_Reduced:
+            return 2;
+        case BodyLod_Far:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static bool body_active(const Schedule_Params & params, const Body_Schedule_Input & body)
+{
+    return body.seconds_since_active < params.active_seconds;
+}
+
+static Body_Lod pick_lod(const Schedule_Params & params, const Body_Schedule_Input & body)
+{
+    if (body_active(params, body))
+    {
+        // a hit or grab has to show, even on a body nobody looks at
+        return BodyLod_Full;
+    }
+    if ((params.sleep_offscreen && !body.visible) || (params.sleep_resting && body.resting))
+    {
+        return BodyLod_Asleep;
+    }
+    if (body.screen_size >= params.reduced_screen_size)
+    {
+        return BodyLod_Full;
+    }
+    return body.screen_size >= params.far_screen_size ? BodyLod_Reduced : BodyLod_Far;
+}
+
+static float body_priority(const Schedule_Params & params, const Body_Schedule_Input & body)
+{
+    // a body passed over goes ahead of every body that was not, the longest
+    // waiting first, so a tight budget takes turns instead of freezing some
+    const float priority = body.screen_size + body.starved_frames * 1e3f;
+    return body_active(params, body) ? priority + 1e6f : priority;
+}
+
+void schedule_bodies(Body_Scheduler & scheduler, const Schedule_Params & params,
+                     const TArray<Body_Schedule_Input> & inputs, TArray<Body_Schedule> & schedules)
+{
+    const int32 num_bodies = inputs.Num();
+    schedules.SetNum(num_bodies);
+    scheduler.order.Reset();
+    
+    for (int32 i = 0; i < num_bodies; ++i)
+    {
+        const Body_Schedule_Input & body = inputs[i];
+        Body_Schedule & schedule = schedules[i];
+        schedule.lod = pick_lod(params, body);
+        schedule.starved = false;
+        
+        // bodies of the same lod take turns instead of all stepping on the same frame
+        const int32 interval = body_lod_interval(schedule.lod);
+        const bool due = interval > 0 && (scheduler.frame + i) % interval == 0;
+        schedule.steps = !due ? 0 : (schedule.lod == BodyLod_Full ? body.wanted_steps : FMath::Min(body.wanted_steps, 1));
+        if (schedule.steps > 0)
+        {
+            scheduler.order.Add(i);
+        }
+    }
+    ++scheduler.frame;
+    
+    if (params.budget_ms <= 0.0f)
+    {
+        return;
+    }
+    
+    scheduler.order.Sort([&](int32 a, int32 b)
+    {
+        return body_priority(params, inputs[a]) > body_priority(params, inputs[b]);
+    });
+    
+    // one step for every body first, so a tight budget slows all of them down
+    // instead of freezing some, then the steps they wanted beyond that
+    double budget = params.budget_ms * 1e-3;
+    // Init rather than SetNumZeroed, which keeps last frame's grants
+    scheduler.granted.Init(0, num_bodies);
+    for (int32 pass = 0; pass < 2; ++pass)
+    {
+        for (int32 n = 0; n < scheduler.order.Num(); ++n)
+        {
+            const int32 i = scheduler.order[n];
+            const double step_cost = inputs[i].points * scheduler.seconds_per_point_step;
+            const int32 wanted = pass == 0 ? 1 : schedules[i].steps - scheduler.granted[i];
+            
+            int32 steps = wanted;
+            if (step_cost * steps > budget)
+            {
+                steps = FMath::Max((int32)(budget / step_cost), 0);
+                // the budget never stops the most important body entirely
+                steps = (pass == 0 && n == 0) ? 1 : steps;
+            }
+            
+            scheduler.granted[i] += steps;
+            budget -= step_cost * steps;
+        }
+    }
+    
+    for (int32 i : scheduler.order)
+    {
+        schedules[i].starved = scheduler.granted[i] == 0;
+        schedules[i].steps = scheduler.granted[i];
+    }
+}
+
+void schedule_report(Body_Scheduler & scheduler, int64 point_steps, double seconds)
+{
+    if (point_steps <= 0 || seconds <= 0.0)
+    {
+        return;
+    }
+    
+    const double measured = seconds / point_steps;
+    scheduler.seconds_per_point_step += (measured - scheduler.seconds_per_point_step) * SCHEDULE_COST_SMOOTHING;
+}
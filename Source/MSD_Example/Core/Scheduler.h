@@ -0,0 +1,84 @@
+#pragma once
+
+#include "MSDCore.h"
+
+// Shares one per frame simulation budget between many bodies. Every frame the
+// caller describes each body, the scheduler picks a level of detail for it and
+// how many steps it may run, and afterwards the caller reports what the steps
+// actually cost so the next frame's estimate follows the hardware.
+
+enum Body_Lod
+{
+    // every frame, as many steps as the body's time asks for
+    BodyLod_Full = 0,
+    // every other frame, one step, time beyond that is dropped
+    BodyLod_Reduced,
+    // every fourth frame, one step
+    BodyLod_Far,
+    // no steps, no uploads, until the body is hit, grabbed or seen again
+    BodyLod_Asleep
+};
+
+struct Schedule_Params
+{
+    // simulation time of all bodies per frame in milliseconds, 0 for no limit
+    float budget_ms = 0.0f;
+    // projected radius over half the view height below which a body runs at
+    // the reduced and at the far rate
+    float reduced_screen_size = 0.1f;
+    float far_screen_size = 0.025f;
+    // seconds a hit or grab keeps a body at the full rate, wherever it is
+    float active_seconds = 2.0f;
+    // put bodies to sleep that are off screen or whose points all rest
+    bool sleep_offscreen = true;
+    bool sleep_resting = true;
+};
+
+// What the scheduler needs to know about one body this frame.
+struct Body_Schedule_Input
+{
+    // points one step simulates, the awake ones when chunks sleep
+    int32 points = 0;
+    // steps the body's accumulated time asks for
+    int32 wanted_steps = 0;
+    float screen_size = 0.0f;
+    bool visible = true;
+    bool resting = false;
+    // seconds since the body was last hit or grabbed
+    float seconds_since_active = 1e9f;
+    // frames in a row the budget left the body without its steps
+    int32 starved_frames = 0;
+};
+
+struct Body_Schedule
+{
+    Body_Lod lod = BodyLod_Full;
+    // steps to run this frame, 0 when the body skips it
+    int32 steps = 0;
+    // the lod wanted steps and the budget granted none
+    bool starved = false;
+};
+
+struct Body_Scheduler
+{
+    // running estimate of one point step, corrected by schedule_report
+    double seconds_per_point_step = 20e-9;
+    uint32 frame = 0;
+    
+    // scratch of schedule_bodies
+    TArray<int32> order;
+    TArray<int32> granted;
+};
+
+// Fills schedules with one entry per input. Bodies are granted their steps in
+// order of priority, active ones first and then by screen size, until the
+// estimated cost reaches the budget. Bodies left without steps go first on
+// their next turn, so none of them freezes for good.
+void schedule_bodies(Body_Scheduler & scheduler, const Schedule_Params & params,
+                     const TArray<Body_Schedule_Input> & inputs, TArray<Body_Schedule> & schedules);
+
+// Measured cost of the steps run since the last call.
+void schedule_report(Body_Scheduler & scheduler, int64 point_steps, double seconds);
+
+// Frames between two updates of a body at lod, 0 for never.
+int32 body_lod_interval(Body_Lod lod);
@@ -0,0 +1,559 @@
+#include "Snapshot.h"
+#include "Plasticity.h"
+#include "MSDStats.h"
+
+#define SNAPSHOT_MAGIC 0x5344534D
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HAS_VELOCITY 1
+#define SNAPSHOT_HAS_TORN 2
+#define SNAPSHOT_HAS_YIELD 4
+
+struct Snapshot_Header
+{
+    uint32 magic;
+    uint16 version;
+    uint16 flags;
+    int32 num_points;
+    float position_step;
+    float velocity_step;
+};
+
+static uint32 zigzag(int32 value)
+{
+    return ((uint32)value << 1) ^ (uint32)(value >> 31);
+}
+
+static int32 unzigzag(uint32 value)
+{
+    return (int32)(value >> 1) ^ -(int32)(value & 1);
+}
+
+static FIntVector quantize(const FVector & v, const FVector & base, float inv_step)
+{
+    return FIntVector(FMath::RoundToInt((v.X - base.X) * inv_step), FMath::RoundToInt((v.Y - base.Y) * inv_step), FMath::RoundToInt((v.Z - base.Z) * inv_step));
+}
+
+// Appends values as zigzag varints, a zero is followed by the length of its run
+// less one. Bytes go straight into out, which only grows.
+struct Snapshot_Writer
+{
+    void put(uint32 value)
+    {
+        while (value >= 0x80)
+        {
+            data[size++] = (uint8)(value | 0x80);
+            value >>= 7;
+        }
+        data[size++] = (uint8)value;
+    }
+    
+    void flush_zeros()
+    {
+        if (zeros)
+        {
+            data[size++] = 0;
+            put(zeros - 1);
+            zeros = 0;
+        }
+    }
+    
+    void add(int32 value)
+    {
+        if (!value)
+        {
+            ++zeros;
+            return;
+        }
+        flush_zeros();
+        put(zigzag(value));
+    }
+    
+    // the offset from base in multiples of step, per axis
+    void add(const FVector & v, const FVector & base, float inv_step)
+    {
+        // three values and the run before them, five bytes each at most
+        reserve(20);
+        const FIntVector q = quantize(v, base, inv_step);
+        add(q.X);
+        add(q.Y);
+        add(q.Z);
+    }
+    
+    void reserve(int32 bytes)
+    {
+        if (size + bytes > out.Num())
+        {
+            out.SetNumUninitialized(FMath::Max(out.Num() * 2, size + bytes), false);
+            data = out.GetData();
+        }
+    }
+    
+    void finish()
+    {
+        reserve(10);
+        flush_zeros();
+        out.SetNumUninitialized(size, false);
+    }
+    
+    TArray<uint8> & out;
+    uint8 * data;
+    int32 size;
+    uint32 zeros;
+};
+
+struct Snapshot_Reader
+{
+    bool get(uint32 & value)
+    {
+        value = 0;
+        for (int32 shift = 0; shift < 35; shift += 7)
+        {
+            if (at >= end)
+            {
+                return false;
+            }
+            const uint8 byte = *at++;
+            value |= (uint32)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    bool next(int32 & value)
+    {
+        if (zeros)
+        {
+            --zeros;
+            value = 0;
+            return true;
+        }
+        
+        uint32 raw;
+        if (!get(raw))
+        {
+            return false;
+        }
+        if (!raw)
+        {
+            if (!get(zeros))
+            {
+                return false;
+            }
+            value = 0;
+            return true;
+        }
+        value = unzigzag(raw);
+        return true;
+    }
+    
+    bool next(FVector & v, const FVector & base, float step)
+    {
+        int32 x, y, z;
+        if (!next(x) || !next(y) || !next(z))
+        {
+            return false;
+        }
+        v = base + FVector(x, y, z) * step;
+        return true;
+    }
+    
+    const uint8 * at;
+    const uint8 * end;
+    uint32 zeros;
+};
+
+void snapshot_save(const Particle_Store & points, const Snapshot_Params & params, TArray<uint8> & out)
+{
+    const int32 count = points.Num();
+    const bool velocities = params.velocity_step > 0.0f;
+    
+    Snapshot_Header header;
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    const bool torn = points.torn_springs.Num() > 0;
+    const bool yielded = points.spring_rest.Num() > 0;
+    header.flags = (velocities ? SNAPSHOT_HAS_VELOCITY : 0) | (torn ? SNAPSHOT_HAS_TORN : 0) | (yielded ? SNAPSHOT_HAS_YIELD : 0);
+    header.num_points = count;
+    header.position_step = params.position_step;
+    header.velocity_step = params.velocity_step;
+    
+    // keeps the buffer, a recorder slot is written again and again
+    out.SetNumUninitialized(FMath::Max(out.Num(), (int32)sizeof(header)), false);
+    FMemory::Memcpy(out.GetData(), &header, sizeof(header));
+    
+    Snapshot_Writer writer{out, out.GetData(), (int32)sizeof(header), 0};
+    const FVector * rest = points.topology->rest.GetData();
+    const float inv_position_step = 1.0f / params.position_step;
+    for (int32 idx = 0; idx < count; ++idx)
+    {
+        writer.add(points.pos[idx], rest[idx], inv_position_step);
+    }
+    if (velocities)
+    {
+        const float inv_velocity_step = 1.0f / params.velocity_step;
+        for (int32 idx = 0; idx < count; ++idx)
+        {
+            writer.add(points.vel[idx], FVector(0, 0, 0), inv_velocity_step);
+        }
+    }
+    if (torn)
+    {
+        // in the order they tore, the drag of their ends depends on it
+        writer.reserve(20);
+        writer.add(points.torn_springs.Num());
+        int32 last = 0;
+        for (int32 s : points.torn_springs)
+        {
+            writer.reserve(20);
+            writer.add(s - last);
+            last = s;
+        }
+    }
+    if (yielded)
+    {
+        const FVector * spring_rest = points.topology->spring_rest.GetData();
+        for (int32 s = 0; s < points.spring_rest.Num(); ++s)
+        {
+            writer.add(points.spring_rest[s], spring_rest[s], inv_position_step);
+        }
+    }
+    writer.finish();
+}
+
+static bool read_header(const TArray<uint8> & data, int32 num_points, Snapshot_Header & header)
+{
+    if (data.Num() < (int32)sizeof(header))
+    {
+        return false;
+    }
+    FMemory::Memcpy(&header, data.GetData(), sizeof(header));
+    return header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION && header.num_points == num_points;
+}
+
+// Reads the sections of data in order into the outputs given. The plastic
+// sections are only read with a topology to check the springs against.
+static bool snapshot_decode(const TArray<uint8> & data, const TArray<FVector> & rest, const Lattice_Topology * topology,
+                            TArray<FVector> * out_pos, TArray<FVector> * out_vel, TArray<int32> * out_torn, TArray<FVector> * out_rest_offsets)
+{
+    const int32 count = rest.Num();
+    Snapshot_Header header;
+    if (!read_header(data, count, header))
+    {
+        return false;
+    }
+    
+    Snapshot_Reader reader{data.GetData() + sizeof(header), data.GetData() + data.Num(), 0};
+    FVector skipped;
+    if (out_pos)
+    {
+        out_pos->SetNumUninitialized(count);
+    }
+    for (int32 idx = 0; idx < count; ++idx)
+    {
+        if (!reader.next(out_pos ? (*out_pos)[idx] : skipped, rest[idx], header.position_step))
+        {
+            return false;
+        }
+    }
+    if (out_vel)
+    {
+        out_vel->SetNumZeroed(count);
+    }
+    if (header.flags & SNAPSHOT_HAS_VELOCITY)
+    {
+        for (int32 idx = 0; idx < count; ++idx)
+        {
+            if (!reader.next(out_vel ? (*out_vel)[idx] : skipped, FVector(0, 0, 0), header.velocity_step))
+            {
+                return false;
+            }
+        }
+    }
+    
+    if (!topology)
+    {
+        return true;
+    }
+    const int32 num_springs = topology->num_springs();
+    if (out_torn)
+    {
+        out_torn->Reset();
+    }
+    if (header.flags & SNAPSHOT_HAS_TORN)
+    {
+        int32 num_torn;
+        if (!reader.next(num_torn) || num_torn < 0 || num_torn > num_springs)
+        {
+            return false;
+        }
+        int32 s = 0;
+        for (int32 i = 0; i < num_torn; ++i)
+        {
+            int32 step;
+            if (!reader.next(step))
+            {
+                return false;
+            }
+            s += step;
+            if (s < 0 || s >= num_springs)
+            {
+                return false;
+            }
+            if (out_torn)
+            {
+                out_torn->Add(s);
+            }
+        }
+    }
+    if (out_rest_offsets)
+    {
+        out_rest_offsets->Reset();
+    }
+    if ((header.flags & SNAPSHOT_HAS_YIELD) && out_rest_offsets)
+    {
+        out_rest_offsets->SetNumUninitialized(num_springs);
+        for (int32 s = 0; s < num_springs; ++s)
+        {
+            if (!reader.next((*out_rest_offsets)[s], topology->spring_rest[s], header.position_step))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool snapshot_read_positions(const TArray<uint8> & data, const TArray<FVector> & rest, TArray<FVector> & out)
+{
+    return snapshot_decode(data, rest, nullptr, &out, nullptr, nullptr, nullptr);
+}
+
+bool snapshot_read_torn(const TArray<uint8> & data, const Lattice_Topology & topology, TArray<int32> & out)
+{
+    return snapshot_decode(data, topology.rest, &topology, nullptr, nullptr, &out, nullptr);
+}
+
+bool snapshot_load(Particle_Store & points, const TArray<uint8> & data)
+{
+    // decoded aside first, a damaged snapshot leaves the body alone
+    TArray<FVector> pos;
+    TArray<FVector> vel;
+    TArray<int32> torn;
+    TArray<FVector> rest_offsets;
+    if (!snapshot_decode(data, points.topology->rest, points.topology, &pos, &vel, &torn, &rest_offsets))
+    {
+        return false;
+    }
+    
+    Swap(points.pos, pos);
+    Swap(points.vel, vel);
+    // the springs as they were when the snapshot was taken
+    plastic_restore(points, torn, rest_offsets);
+    // no interpolation across the jump, the solver sizes these again and
+    // wakes everything on its next step
+    points.pos_next.Reset();
+    points.vel_next.Reset();
+    points.sleep.reset();
+    return true;
+}
+
+void recorder_capture(State_Recorder & recorder, const Particle_Store & points)
+{
+    if (!recorder.frames.Num())
+    {
+        return;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_Record);
+    snapshot_save(points, recorder.params, recorder.frames[recorder.next]);
+    recorder.next = (recorder.next + 1) % recorder.frames.Num();
+    recorder.count = FMath::Min(recorder.count + 1, recorder.frames.Num());
+}
+
+#define KEYFRAME_MAGIC 0x464B534D
+// index step and three values, five bytes each at most
+#define KEYFRAME_MAX_ENTRY 20
+// one spring step
+#define KEYFRAME_MAX_TORN 5
+
+struct Keyframe_Header
+{
+    uint32 magic;
+    uint32 sequence;
+    int32 num_points;
+    float position_step;
+    // torn springs ahead of the points
+    int32 num_torn;
+};
+
+int32 keyframe_write(Keyframe_State & state, const TArray<FVector> & positions, const TArray<FVector> & rest, const TArray<int32> & torn,
+                     const Keyframe_Params & params, TArray<uint8> & out)
+{
+    const int32 count = positions.Num();
+    if (!count || count != rest.Num())
+    {
+        return 0;
+    }
+    if (state.sent.Num() != count)
+    {
+        // clients start from the rest pose
+        state.sent = rest;
+        state.cursor = 0;
+        state.refresh_cursor = 0;
+        state.refresh_left = count;
+        state.torn_sent = 0;
+        state.torn_cursor = 0;
+    }
+    if (state.torn_sent > torn.Num())
+    {
+        // the body healed, its tears start over
+        state.torn_sent = 0;
+        state.torn_cursor = 0;
+    }
+    
+    // the header goes in front once it is clear there is anything to send
+    Keyframe_Header header;
+    out.SetNumUninitialized(FMath::Max(out.Num(), (int32)sizeof(header)), false);
+    Snapshot_Writer writer{out, out.GetData(), (int32)sizeof(header), 0};
+    
+    // new tears first, then the older ones in turn while points are sent in
+    // turn, so a lost keyframe only delays a tear. Tears take the refresh
+    // part of the budget at most
+    const int32 torn_budget = FMath::Min((int32)sizeof(header) + (int32)(params.byte_budget * params.refresh_share), params.byte_budget);
+    int32 num_torn = 0;
+    int32 last_torn = 0;
+    auto write_torn = [&](int32 s)
+    {
+        writer.reserve(KEYFRAME_MAX_TORN);
+        writer.put(zigzag(s - last_torn));
+        last_torn = s;
+        ++num_torn;
+    };
+    for (; state.torn_sent < torn.Num() && writer.size + KEYFRAME_MAX_TORN <= torn_budget; ++state.torn_sent)
+    {
+        write_torn(torn[state.torn_sent]);
+    }
+    if (num_torn)
+    {
+        state.refresh_left = count;
+    }
+    const int32 repeat_torn = state.refresh_left > 0 ? state.torn_sent - num_torn : 0;
+    for (int32 i = 0; i < repeat_torn && writer.size + KEYFRAME_MAX_TORN <= torn_budget; ++i)
+    {
+        state.torn_cursor %= state.torn_sent - num_torn;
+        write_torn(torn[state.torn_cursor++]);
+    }
+    
+    const float inv_step = 1.0f / params.position_step;
+    const float error_sq = params.error_bound * params.error_bound;
+    int32 written = 0;
+    int32 last = 0;
+    auto write = [&](int32 idx)
+    {
+        const FIntVector q = quantize(positions[idx], rest[idx], inv_step);
+        writer.reserve(KEYFRAME_MAX_ENTRY);
+        writer.put(zigzag(idx - last));
+        writer.put(zigzag(q.X));
+        writer.put(zigzag(q.Y));
+        writer.put(zigzag(q.Z));
+        // the clients hold the quantized position, the error is measured from it
+        state.sent[idx] = rest[idx] + FVector(q.X, q.Y, q.Z) * params.position_step;
+        last = idx;
+        ++written;
+    };
+    
+    // room for one moved point at least, within the budget
+    const int32 changed_budget = FMath::Min(FMath::Max(params.byte_budget - (int32)(params.byte_budget * params.refresh_share), (int32)sizeof(header) + KEYFRAME_MAX_ENTRY), params.byte_budget);
+    int32 visited = 0;
+    for (; visited < count && writer.size + KEYFRAME_MAX_ENTRY <= changed_budget; ++visited)
+    {
+        const int32 idx = (state.cursor + visited) % count;
+        if (FVector::DistSquared(positions[idx], state.sent[idx]) > error_sq)
+        {
+            write(idx);
+        }
+    }
+    // the points that did not fit are looked at first next time
+    state.cursor = (state.cursor + visited) % count;
+    
+    // a point that moved starts a whole round of points sent in turn again
+    if (written)
+    {
+        state.refresh_left = count;
+    }
+    for (; state.refresh_left > 0 && writer.size + KEYFRAME_MAX_ENTRY <= params.byte_budget; --state.refresh_left)
+    {
+        write(state.refresh_cursor);
+        state.refresh_cursor = (state.refresh_cursor + 1) % count;
+    }
+    if (!written && !num_torn)
+    {
+        return 0;
+    }
+    
+    header.magic = KEYFRAME_MAGIC;
+    header.sequence = ++state.sequence;
+    header.num_points = count;
+    header.position_step = params.position_step;
+    header.num_torn = num_torn;
+    writer.finish();
+    FMemory::Memcpy(out.GetData(), &header, sizeof(header));
+    return written + num_torn;
+}
+
+bool keyframe_read(const TArray<uint8> & data, const TArray<FVector> & rest, int32 num_springs, uint32 & sequence,
+                   TArray<int32> & out_points, TArray<FVector> & out_positions, TArray<int32> & out_torn)
+{
+    Keyframe_Header header;
+    if (data.Num() < (int32)sizeof(header))
+    {
+        return false;
+    }
+    FMemory::Memcpy(&header, data.GetData(), sizeof(header));
+    if (header.magic != KEYFRAME_MAGIC || header.num_points != rest.Num())
+    {
+        return false;
+    }
+    
+    sequence = header.sequence;
+    out_points.Reset();
+    out_positions.Reset();
+    out_torn.Reset();
+    Snapshot_Reader reader{data.GetData() + sizeof(header), data.GetData() + data.Num(), 0};
+    int32 s = 0;
+    for (int32 i = 0; i < header.num_torn; ++i)
+    {
+        uint32 step;
+        if (!reader.get(step))
+        {
+            return false;
+        }
+        s += unzigzag(step);
+        if (s < 0 || s >= num_springs)
+        {
+            return false;
+        }
+        out_torn.Add(s);
+    }
+    
+    int32 idx = 0;
+    while (reader.at < reader.end)
+    {
+        uint32 step, x, y, z;
+        if (!reader.get(step) || !reader.get(x) || !reader.get(y) || !reader.get(z))
+        {
+            return false;
+        }
+        idx += unzigzag(step);
+        if (idx < 0 || idx >= header.num_points)
+        {
+            return false;
+        }
+        out_points.Add(idx);
+        out_positions.Add(rest[idx] + FVector(unzigzag(x), unzigzag(y), unzigzag(z)) * header.position_step);
+    }
+    return true;
+}
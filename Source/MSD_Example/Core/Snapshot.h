@@ -0,0 +1,126 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+
+// Compact state of one body for save games, bug repros and replays. Positions
+// are stored as offsets from the rest pose in multiples of position_step,
+// velocities optionally in multiples of velocity_step. Every value is a zigzag
+// varint and runs of zeros, the resting and pinned parts of the body, collapse
+// to two bytes each. Torn springs and yielded rest offsets follow when the body
+// has any. A snapshot only fits bodies of the same point count.
+struct Snapshot_Params
+{
+    // precision of the positions in cm
+    float position_step = 0.01f;
+    // precision of the velocities in cm/s, 0 leaves them out and the body is
+    // restored at rest
+    float velocity_step = 0.0f;
+};
+
+void snapshot_save(const Particle_Store & points, const Snapshot_Params & params, TArray<uint8> & out);
+
+// Replaces positions, velocities and plastic state of points and wakes every
+// chunk. Returns false and leaves points as they are when data is damaged or
+// does not fit.
+bool snapshot_load(Particle_Store & points, const TArray<uint8> & data);
+
+// Only the positions of a snapshot, relative to rest, without a store.
+bool snapshot_read_positions(const TArray<uint8> & data, const TArray<FVector> & rest, TArray<FVector> & out);
+
+// Only the torn springs of a snapshot, in the order they tore.
+bool snapshot_read_torn(const TArray<uint8> & data, const Lattice_Topology & topology, TArray<int32> & out);
+
+// The last steps of one body, a snapshot each, overwritten oldest first. The
+// buffers are kept across the ring, capturing a step allocates nothing once
+// every slot was written.
+struct State_Recorder
+{
+    void reset(int32 capacity)
+    {
+        frames.SetNum(FMath::Max(capacity, 0));
+        next = 0;
+        count = 0;
+    }
+    
+    int32 Num() const { return count; }
+    
+    // recorded step i, oldest first
+    const TArray<uint8> & frame(int32 i) const
+    {
+        return frames[(next - count + i + frames.Num()) % frames.Num()];
+    }
+    
+    SIZE_T allocated_size() const
+    {
+        SIZE_T size = frames.GetAllocatedSize();
+        for (const TArray<uint8> & data : frames)
+        {
+            size += data.GetAllocatedSize();
+        }
+        return size;
+    }
+    
+    Snapshot_Params params;
+    TArray<TArray<uint8>> frames;
+    int32 next = 0;
+    int32 count = 0;
+};
+
+void recorder_capture(State_Recorder & recorder, const Particle_Store & points);
+
+// Positions sent from a server to its clients. A keyframe holds the points
+// that moved further than error_bound from what the clients were last sent,
+// as quantized offsets from rest, plus a few points in turn whatever their
+// error, so a lost keyframe or a client that joined late catches up over time.
+// Once every point was sent in turn since the last one that moved, a body at
+// rest sends nothing. Springs torn on the server go along, and are repeated in
+// turn while points are. Yielded rest offsets are not sent, the positions pull
+// the clients' own yield along. Keyframes never exceed byte_budget, the points
+// that did not fit go first in the next one.
+struct Keyframe_Params
+{
+    float position_step = 0.1f;
+    float error_bound = 0.5f;
+    int32 byte_budget = 1024;
+    // part of the budget for points sent in turn
+    float refresh_share = 0.25f;
+};
+
+// What the server last sent for every point.
+struct Keyframe_State
+{
+    // the sequence goes on, clients drop keyframes not newer than their last
+    // one and would ignore a body that started over from 0
+    void reset()
+    {
+        sent.Reset();
+        cursor = 0;
+        refresh_cursor = 0;
+        refresh_left = 0;
+        torn_sent = 0;
+        torn_cursor = 0;
+    }
+    
+    TArray<FVector> sent;
+    // where the search for moved points and the points sent in turn go on
+    int32 cursor = 0;
+    int32 refresh_cursor = 0;
+    // points still to send in turn before the refresh stops
+    int32 refresh_left = 0;
+    // torn springs sent once, and the next of them to send again
+    int32 torn_sent = 0;
+    int32 torn_cursor = 0;
+    uint32 sequence = 0;
+};
+
+// Fills out with the next keyframe and returns the points and torn springs it
+// holds, no keyframe needs to be sent for 0. torn are the body's torn springs
+// in the order they tore.
+int32 keyframe_write(Keyframe_State & state, const TArray<FVector> & positions, const TArray<FVector> & rest, const TArray<int32> & torn,
+                     const Keyframe_Params & params, TArray<uint8> & out);
+
+// The points of a keyframe, their positions and the torn springs it repeats.
+// False when data is damaged or from a lattice with another point count.
+bool keyframe_read(const TArray<uint8> & data, const TArray<FVector> & rest, int32 num_springs, uint32 & sequence,
+                   TArray<int32> & out_points, TArray<FVector> & out_positions, TArray<int32> & out_torn);
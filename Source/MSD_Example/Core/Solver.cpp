@@ -0,0 +1,699 @@
+#include "Solver.h"
+#include "ImplicitSolver.h"
+#include "MSDStats.h"
+
+
+// largest accepted stencil mismatch, relative to the largest force component
+#define STENCIL_TOLERANCE 1e-5f
+
+
+static void neighbour_forces_range(const Particle_Store & points, const FVector * pos, const FVector * vel,
+                                   float k, float damping, FVector * force, int32 begin, int32 end)
+{
+    const Lattice_Topology & topology = *points.topology;
+    const FVector * rest = topology.rest.GetData();
+    const int32 * neighbour_offsets = topology.neighbour_offsets.GetData();
+    const int32 * neighbour_list = topology.neighbour_list.GetData();
+    const int32 * neighbour_spring = topology.neighbour_spring.GetData();
+    const int32 * spring_a = topology.spring_a.GetData();
+    // plastic bodies keep their own rest offsets per spring
+    const FVector * spring_rest = points.spring_rest.Num() ? points.spring_rest.GetData() : nullptr;
+    const float * stiffness_weights = points.stiffness_weights();
+    const float * damping_weights = points.damping_weights();
+    
+    for (int32 idx = begin; idx < end; ++idx)
+    {
+        const FVector point_pos = pos[idx];
+        const FVector point_vel = vel[idx];
+        FVector point_force = FVector(0, 0, 0);
+        
+        for (int32 i = neighbour_offsets[idx]; i < neighbour_offsets[idx + 1]; ++i)
+        {
+            int32 ni = neighbour_list[i];
+            const float stiffness = stiffness_weights[neighbour_spring[i]];
+            const float spring_damping = damping_weights[neighbour_spring[i]];
+            
+            FVector offset = rest[idx] - rest[ni];
+            if (spring_rest)
+            {
+                const int32 s = neighbour_spring[i];
+                offset = spring_a[s] == idx ? spring_rest[s] : -spring_rest[s];
+            }
+            FVector anchor = pos[ni] + offset;
+            FVector dist = point_pos - anchor;
+            
+            FVector spring_force = -(k * stiffness) * dist;
+            FVector damping_force = (damping * spring_damping) * point_vel;
+            
+            point_force += spring_force - damping_force;
+        }
+        
+        force[idx] = point_force;
+    }
+}
+
+// chunk is awake or has springs into an awake one, so its state is read this step
+static bool chunk_needed(const Sleep_State & sleep, int32 chunk)
+{
+    for (int32 i = sleep.adjacency_offsets[chunk]; i < sleep.adjacency_offsets[chunk + 1]; ++i)
+    {
+        if (sleep.chunk_awake[sleep.adjacency_list[i]])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void spring_forces(const Particle_Store & points, const Solver_Params & params,
+                          const FVector * pos, const FVector * vel, float damping, FVector * force)
+{
+    const Lattice_Topology & topology = *points.topology;
+    const Sleep_State & sleep = points.sleep;
+    const int32 chunk_points = sleep.chunk_points;
+    const uint8 * chunk_awake = sleep.chunk_awake.GetData();
+    const float * drag_weights = points.drag_weights();
+    
+    // the damping drag starts every sum. Resting chunks next to awake ones
+    // collect their end of the shared springs too, it is simply never used
+    solver_parallel_chunks(points.Num(), chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        if (!chunk_needed(sleep, begin / chunk_points))
+        {
+            return;
+        }
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            force[idx] = vel[idx] * -(damping * drag_weights[idx]);
+        }
+    });
+    
+    const int32 * spring_a = topology.spring_a.GetData();
+    const int32 * spring_b = topology.spring_b.GetData();
+    const FVector * spring_rest = points.rest_offsets();
+    const float * spring_stiffness = points.stiffness_weights();
+    const bool all_awake = !sleep.chunk_awake.Contains(0);
+    const float k = params.k;
+    
+    // even blocks first, then odd ones, so every point sums its springs in the
+    // same order whatever the number of workers
+    const int32 num_blocks = topology.num_spring_blocks();
+    for (int32 parity = 0; parity < 2; ++parity)
+    {
+        ParallelFor((num_blocks + 1 - parity) / 2, [&](int32 i)
+        {
+            const int32 block = 2 * i + parity;
+            const int32 end = topology.spring_block_offsets[block + 1];
+            for (int32 s = topology.spring_block_offsets[block]; s < end; ++s)
+            {
+                const int32 a = spring_a[s];
+                const int32 b = spring_b[s];
+                if (!all_awake && !chunk_awake[a / chunk_points] && !chunk_awake[b / chunk_points])
+                {
+                    continue;
+                }
+                
+                const FVector spring_force = (pos[b] - pos[a] + spring_rest[s]) * (k * spring_stiffness[s]);
+                force[a] += spring_force;
+                force[b] -= spring_force;
+            }
+        }, !params.multithreaded);
+    }
+}
+
+static void verify_stencil(const Lattice_Stencil & stencil, const Solver_Params & params, const FVector * pos, const FVector * vel, const FVector * force)
+{
+    if (params.isa == SimdIsa_Scalar)
+    {
+        return;
+    }
+    
+    float scale = 0.0f;
+    for (int32 idx = 0; idx < stencil.rest_sum.Num(); ++idx)
+    {
+        scale = FMath::Max(scale, force[idx].GetAbs().GetMax());
+    }
+    
+    float error = stencil_verify(stencil, pos, vel, params.k, params.damping, force);
+    if (error > STENCIL_TOLERANCE * FMath::Max(scale, 1.0f))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s stencil differs from scalar by %f (max force %f)"), simd_isa_name(params.isa), error, scale);
+    }
+}
+
+bool solver_uses_stencil(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    // the stencil has one stiffness for every spring
+    return params.use_stencil && stencil.is_valid_for(points) && !points.has_material();
+}
+
+bool solver_uses_springs(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    return params.use_springs && !solver_uses_stencil(points, stencil, params);
+}
+
+int32 solver_chunk_points(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    if (solver_uses_stencil(points, stencil, params))
+    {
+        return FMath::Max(1, SOLVER_CHUNK_POINTS / stencil.size.X) * stencil.size.X;
+    }
+    return SOLVER_CHUNK_POINTS;
+}
+
+void solver_parallel_chunks(int32 count, int32 chunk_points, bool multithreaded, TFunctionRef<void(int32 begin, int32 end)> body)
+{
+    const int32 num_chunks = FMath::DivideAndRoundUp(count, chunk_points);
+    ParallelFor(num_chunks, [&](int32 chunk)
+    {
+        int32 begin = chunk * chunk_points;
+        body(begin, FMath::Min(begin + chunk_points, count));
+    }, !multithreaded);
+}
+
+void solver_free_runs(const Particle_Store & points, int32 begin, int32 end, TFunctionRef<void(int32 begin, int32 end)> body)
+{
+    // first run that ends after begin
+    const int32 * runs = points.free_runs.GetData();
+    int32 first = 0;
+    int32 last = points.free_runs.Num() / 2;
+    while (first < last)
+    {
+        const int32 middle = (first + last) / 2;
+        if (runs[2 * middle + 1] <= begin)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    
+    for (int32 run = first; run < points.free_runs.Num() / 2 && runs[2 * run] < end; ++run)
+    {
+        body(FMath::Max(runs[2 * run], begin), FMath::Min(runs[2 * run + 1], end));
+    }
+}
+
+void solver_forces_prepare(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params,
+                           const FVector * pos, const FVector * vel, float damping, FVector * force)
+{
+    if (solver_uses_springs(points, stencil, params))
+    {
+        MSD_SCOPE_CYCLE(STAT_MSD_Forces);
+        spring_forces(points, params, pos, vel, damping, force);
+    }
+}
+
+void solver_forces_range(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params,
+                         const FVector * pos, const FVector * vel, float damping, FVector * force, int32 begin, int32 end)
+{
+    if (solver_uses_springs(points, stencil, params))
+    {
+        return;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_Forces);
+    if (solver_uses_stencil(points, stencil, params))
+    {
+        stencil_forces(stencil, pos, vel, params.k, damping, force, params.isa, begin / stencil.size.X, end / stencil.size.X);
+    }
+    else
+    {
+        neighbour_forces_range(points, pos, vel, params.k, damping, force, begin, end);
+    }
+}
+
+void solver_forces(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params,
+                   const FVector * pos, const FVector * vel, float damping, FVector * force)
+{
+    solver_forces_prepare(points, stencil, params, pos, vel, damping, force);
+    solver_parallel_chunks(points.Num(), solver_chunk_points(points, stencil, params), params.multithreaded, [&](int32 begin, int32 end)
+    {
+        solver_forces_range(points, stencil, params, pos, vel, damping, force, begin, end);
+    });
+}
+
+static void build_chunk_adjacency(Sleep_State & sleep, const Particle_Store & points, int32 num_chunks)
+{
+    const Lattice_Topology & topology = *points.topology;
+    const int32 chunk_points = sleep.chunk_points;
+    TArray<int32> seen;
+    seen.Init(INDEX_NONE, num_chunks);
+    
+    sleep.adjacency_offsets.SetNumUninitialized(num_chunks + 1);
+    sleep.adjacency_list.Reset();
+    
+    for (int32 chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        sleep.adjacency_offsets[chunk] = sleep.adjacency_list.Num();
+        seen[chunk] = chunk;
+        sleep.adjacency_list.Add(chunk);
+        
+        const int32 end = FMath::Min((chunk + 1) * chunk_points, points.Num());
+        for (int32 idx = chunk * chunk_points; idx < end; ++idx)
+        {
+            for (int32 i = topology.neighbour_offsets[idx]; i < topology.neighbour_offsets[idx + 1]; ++i)
+            {
+                int32 other = topology.neighbour_list[i] / chunk_points;
+                if (seen[other] != chunk)
+                {
+                    seen[other] = chunk;
+                    sleep.adjacency_list.Add(other);
+                }
+            }
+        }
+    }
+    sleep.adjacency_offsets[num_chunks] = sleep.adjacency_list.Num();
+}
+
+void solver_prepare_sleep(Particle_Store & points, int32 chunk_points, bool enabled)
+{
+    Sleep_State & sleep = points.sleep;
+    const int32 count = points.Num();
+    const int32 num_chunks = FMath::DivideAndRoundUp(count, chunk_points);
+    
+    if (sleep.chunk_points != chunk_points || sleep.num_points != count)
+    {
+        sleep.chunk_points = chunk_points;
+        sleep.num_points = count;
+        sleep.still_steps.Init(0, count);
+        sleep.chunk_moving.Init(1, num_chunks);
+        sleep.chunk_awake.Init(1, num_chunks);
+        sleep.chunk_synced.Init(0, num_chunks);
+        sleep.chunk_render_dirty.Init(1, num_chunks);
+        build_chunk_adjacency(sleep, points, num_chunks);
+    }
+    
+    for (int32 chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        uint8 awake = !enabled;
+        for (int32 i = sleep.adjacency_offsets[chunk]; i < sleep.adjacency_offsets[chunk + 1] && !awake; ++i)
+        {
+            awake = sleep.chunk_moving[sleep.adjacency_list[i]];
+        }
+        sleep.chunk_awake[chunk] = awake;
+    }
+}
+
+bool solver_skip_resting_chunk(Particle_Store & points, int32 begin, int32 end)
+{
+    Sleep_State & sleep = points.sleep;
+    const int32 chunk = begin / sleep.chunk_points;
+    
+    if (sleep.chunk_awake[chunk])
+    {
+        sleep.chunk_synced[chunk] = false;
+        sleep.chunk_render_dirty[chunk] = true;
+        return false;
+    }
+    
+    if (!sleep.chunk_synced[chunk])
+    {
+        const int32 num = end - begin;
+        FMemory::Memcpy(&points.pos_next[begin], &points.pos[begin], num * sizeof(FVector));
+        FMemory::Memzero(&points.vel[begin], num * sizeof(FVector));
+        FMemory::Memzero(&points.vel_next[begin], num * sizeof(FVector));
+        sleep.chunk_synced[chunk] = true;
+        sleep.chunk_render_dirty[chunk] = true;
+    }
+    return true;
+}
+
+void solver_update_resting(Particle_Store & points, const Solver_Params & params, int32 begin, int32 end)
+{
+    Sleep_State & sleep = points.sleep;
+    const FVector * pos = points.pos.GetData();
+    const FVector * pos_next = points.pos_next.GetData();
+    const FVector * vel_next = points.vel_next.GetData();
+    uint8 * still_steps = sleep.still_steps.GetData();
+    
+    const float max_vel = params.sleep_threshold * params.sleep_threshold;
+    const float max_move = max_vel * params.dt * params.dt;
+    
+    bool moving = false;
+    for (int32 idx = begin; idx < end; ++idx)
+    {
+        bool still = (pos_next[idx] - pos[idx]).SizeSquared() <= max_move && vel_next[idx].SizeSquared() <= max_vel;
+        still_steps[idx] = still ? FMath::Min(still_steps[idx] + 1, SLEEP_STEPS) : 0;
+        moving |= still_steps[idx] < SLEEP_STEPS;
+    }
+    sleep.chunk_moving[begin / sleep.chunk_points] = moving;
+}
+
+static void prepare_buffers(Particle_Store & points)
+{
+    const int32 count = points.Num();
+    points.force.SetNumUninitialized(count);
+    if (points.pos_next.Num() != count)
+    {
+        // pinned points are never written again, both buffers have to agree on them from the start
+        points.pos_next = points.pos;
+        points.vel_next = points.vel;
+    }
+}
+
+static void swap_buffers(Particle_Store & points)
+{
+    Swap(points.pos, points.pos_next);
+    Swap(points.vel, points.vel_next);
+}
+
+// Force and update of a chunk run back to back so the chunk is still in cache
+// when it is integrated. The force of a chunk only reads the front buffers, so
+// chunks never race. The spring table computes its forces up front instead.
+template <typename Update>
+static void force_step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params, Update update)
+{
+    prepare_buffers(points);
+    const int32 chunk_points = solver_chunk_points(points, stencil, params);
+    solver_prepare_sleep(points, chunk_points, params.sleep);
+    
+    const FVector * pos = points.pos.GetData();
+    const FVector * vel = points.vel.GetData();
+    FVector * force = points.force.GetData();
+    
+    solver_forces_prepare(points, stencil, params, pos, vel, params.damping, force);
+    solver_parallel_chunks(points.Num(), chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        if (solver_skip_resting_chunk(points, begin, end))
+        {
+            return;
+        }
+        
+        solver_forces_range(points, stencil, params, pos, vel, params.damping, force, begin, end);
+        {
+            MSD_SCOPE_CYCLE(STAT_MSD_Integrate);
+            update(begin, end);
+        }
+        
+        if (params.sleep)
+        {
+            solver_update_resting(points, params, begin, end);
+        }
+    });
+    
+    // resting chunks leave stale forces behind, only verify fully awake steps
+    if (params.verify_stencil && solver_uses_stencil(points, stencil, params) && !points.sleep.chunk_awake.Contains(false))
+    {
+        verify_stencil(stencil, params, pos, vel, force);
+    }
+    
+    swap_buffers(points);
+}
+
+void Explicit_Euler_Integrator::step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    const float dt = params.dt;
+    force_step(points, stencil, params, [&](int32 begin, int32 end)
+    {
+        const FVector * pos = points.pos.GetData();
+        const FVector * vel = points.vel.GetData();
+        const FVector * force = points.force.GetData();
+        const float * inv_mass = points.inv_mass.GetData();
+        FVector * pos_next = points.pos_next.GetData();
+        FVector * vel_next = points.vel_next.GetData();
+        
+        solver_free_runs(points, begin, end, [&](int32 run_begin, int32 run_end)
+        {
+            for (int32 idx = run_begin; idx < run_end; ++idx)
+            {
+                pos_next[idx] = pos[idx] + (vel[idx] * dt);
+                vel_next[idx] = vel[idx] + ((force[idx] * inv_mass[idx]) * dt);
+            }
+        });
+    });
+}
+
+void Symplectic_Euler_Integrator::step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    const float dt = params.dt;
+    force_step(points, stencil, params, [&](int32 begin, int32 end)
+    {
+        const FVector * pos = points.pos.GetData();
+        const FVector * vel = points.vel.GetData();
+        const FVector * force = points.force.GetData();
+        const float * inv_mass = points.inv_mass.GetData();
+        FVector * pos_next = points.pos_next.GetData();
+        FVector * vel_next = points.vel_next.GetData();
+        
+        solver_free_runs(points, begin, end, [&](int32 run_begin, int32 run_end)
+        {
+            for (int32 idx = run_begin; idx < run_end; ++idx)
+            {
+                const FVector new_vel = vel[idx] + ((force[idx] * inv_mass[idx]) * dt);
+                vel_next[idx] = new_vel;
+                pos_next[idx] = pos[idx] + (new_vel * dt);
+            }
+        });
+    });
+}
+
+void Position_Verlet_Integrator::step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params)
+{
+    const float dt = params.dt;
+    const float half_dt = 0.5f * dt;
+    const int32 count = points.Num();
+    const int32 chunk_points = solver_chunk_points(points, stencil, params);
+    
+    prepare_buffers(points);
+    solver_prepare_sleep(points, chunk_points, params.sleep);
+    half.SetNumUninitialized(count);
+    
+    const FVector * pos = points.pos.GetData();
+    const FVector * vel = points.vel.GetData();
+    const float * inv_mass = points.inv_mass.GetData();
+    FVector * mid = half.GetData();
+    FVector * force = points.force.GetData();
+    FVector * pos_next = points.pos_next.GetData();
+    FVector * vel_next = points.vel_next.GetData();
+    
+    // the midpoint force needs every neighbour drifted first, so this takes two
+    // passes; resting chunks next to awake ones still provide their midpoint
+    const Sleep_State & sleep = points.sleep;
+    solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        MSD_SCOPE_CYCLE(STAT_MSD_Integrate);
+        const bool needed = chunk_needed(sleep, begin / chunk_points);
+        for (int32 idx = begin; needed && idx < end; ++idx)
+        {
+            mid[idx] = pos[idx] + (vel[idx] * half_dt);
+        }
+    });
+    
+    solver_forces_prepare(points, stencil, params, mid, vel, params.damping, force);
+    solver_parallel_chunks(count, chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+    {
+        if (solver_skip_resting_chunk(points, begin, end))
+        {
+            return;
+        }
+        
+        solver_forces_range(points, stencil, params, mid, vel, params.damping, force, begin, end);
+        
+        MSD_SCOPE_CYCLE(STAT_MSD_Integrate);
+        solver_free_runs(points, begin, end, [&](int32 run_begin, int32 run_end)
+        {
+            for (int32 idx = run_begin; idx < run_end; ++idx)
+            {
+                const FVector new_vel = vel[idx] + ((force[idx] * inv_mass[idx]) * dt);
+                vel_next[idx] = new_vel;
+                pos_next[idx] = mid[idx] + (new_vel * half_dt);
+            }
+        });
+        
+        if (params.sleep)
+        {
+            solver_update_resting(points, params, begin, end);
+        }
+    });
+    
+    swap_buffers(points);
+}
+
+TUniquePtr<Integrator> make_integrator(Integrator_Type type)
+{
+    switch (type)
+    {
+        case IntegratorType_SymplecticEuler: return TUniquePtr<Integrator>(new Symplectic_Euler_Integrator());
+        case IntegratorType_PositionVerlet:  return TUniquePtr<Integrator>(new Position_Verlet_Integrator());
+        case IntegratorType_ImplicitEuler:   return TUniquePtr<Integrator>(new Implicit_Euler_Integrator());
+        default:                             return TUniquePtr<Integrator>(new Explicit_Euler_Integrator());
+    }
+}
+
+static void wake_point(Particle_Store & points, int32 idx)
+{
+    Sleep_State & sleep = points.sleep;
+    if (sleep.num_points == points.Num())
+    {
+        sleep.still_steps[idx] = 0;
+        sleep.chunk_moving[idx / sleep.chunk_points] = true;
+    }
+}
+
+void solver_apply_input(Particle_Store & points, const Solver_Input & input)
+{
+    for (int32 s : input.tear_springs)
+    {
+        plastic_tear(points, s);
+    }
+    
+    if (input.correction_pos.Num() == points.Num())
+    {
+        // the velocity stays, only the drift goes
+        for (int32 idx : input.correction_points)
+        {
+            if (points.inv_mass[idx] == 0.0f)
+            {
+                continue;
+            }
+            points.pos[idx] = input.correction_pos[idx];
+            wake_point(points, idx);
+        }
+    }
+    
+    if (input.impulse_vel.Num() == points.Num())
+    {
+        for (int32 idx : input.impulse_points)
+        {
+            if (points.inv_mass[idx] == 0.0f)
+            {
+                // pinned
+                continue;
+            }
+            points.vel[idx] += input.impulse_vel[idx];
+            wake_point(points, idx);
+        }
+    }
+    
+    if (input.has_grab_target)
+    {
+        for (int32 idx : input.grab_points)
+        {
+            if (points.inv_mass[idx] == 0.0f)
+            {
+                continue;
+            }
+            points.vel[idx] -= points.pos[idx] - input.grab_target;
+            wake_point(points, idx);
+        }
+    }
+}
+
+// contacts after a step, only the chunks the step simulated
+static void solver_collide(Particle_Store & points, const Solver_Params & params, const Collision_World & world)
+{
+    const Collision_Params & collision = params.collision;
+    if (collision.thickness <= 0.0f || (world.is_empty() && !collision.self_collision))
+    {
+        return;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_Collision);
+    const Sleep_State & sleep = points.sleep;
+    const bool tracked = sleep.num_points == points.Num();
+    const int32 chunk_points = tracked ? sleep.chunk_points : SOLVER_CHUNK_POINTS;
+    
+    // points pushed apart may end up in the world again, so the world goes last
+    int32 contacts = 0;
+    if (collision.self_collision)
+    {
+        contacts += collision_resolve_self(points, collision, params.multithreaded);
+    }
+    if (!world.is_empty())
+    {
+        TArray<int32> chunk_contacts;
+        chunk_contacts.SetNumZeroed(FMath::DivideAndRoundUp(points.Num(), chunk_points));
+        solver_parallel_chunks(points.Num(), chunk_points, params.multithreaded, [&](int32 begin, int32 end)
+        {
+            if (!tracked || sleep.chunk_awake[begin / chunk_points])
+            {
+                chunk_contacts[begin / chunk_points] = collision_resolve_world(points, world, collision, begin, end);
+            }
+        });
+        for (int32 chunk_count : chunk_contacts)
+        {
+            contacts += chunk_count;
+        }
+    }
+    MSD_ADD_COUNTER(STAT_MSD_Contacts, contacts);
+}
+
+void solver_advance(Particle_Store & points, const Lattice_Stencil & stencil, Integrator & integrator, const Solver_Params & params, const Solver_Input & input, int32 substeps)
+{
+    solver_apply_input(points, input);
+    for (int32 i = 0; i < substeps; ++i)
+    {
+        MSD_SCOPE_CYCLE(STAT_MSD_Step);
+        integrator.step(points, stencil, params);
+        solver_collide(points, params, input.world);
+        plastic_update(points, params.plastic, params.dt, params.multithreaded);
+        if (params.recorder)
+        {
+            recorder_capture(*params.recorder, points);
+        }
+    }
+}
+
+void solver_interpolate(const Particle_Store & points, float alpha, TArray<FVector> & out, bool only_changed)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_Interpolate);
+    const int32 count = points.Num();
+    const Sleep_State & sleep = points.sleep;
+    only_changed = only_changed && out.Num() == count && sleep.num_points == count;
+    out.SetNumUninitialized(count);
+    
+    // no step has run since generation, there is only one state
+    if (points.pos_next.Num() != count)
+    {
+        FMemory::Memcpy(out.GetData(), points.pos.GetData(), count * sizeof(FVector));
+        return;
+    }
+    
+    const FVector * prev = points.pos_next.GetData();
+    const FVector * cur = points.pos.GetData();
+    FVector * result = out.GetData();
+    const int32 chunk_points = only_changed ? sleep.chunk_points : count;
+    
+    for (int32 begin = 0; begin < count; begin += chunk_points)
+    {
+        if (only_changed && !solver_chunk_changed(points, begin / chunk_points))
+        {
+            continue;
+        }
+        
+        const int32 end = FMath::Min(begin + chunk_points, count);
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            result[idx] = prev[idx] + (cur[idx] - prev[idx]) * alpha;
+        }
+    }
+}
+
+bool solver_chunk_changed(const Particle_Store & points, int32 chunk)
+{
+    const Sleep_State & sleep = points.sleep;
+    return sleep.chunk_awake[chunk] || sleep.chunk_render_dirty[chunk];
+}
+
+int32 solver_awake_points(const Particle_Store & points)
+{
+    const Sleep_State & sleep = points.sleep;
+    if (sleep.num_points != points.Num())
+    {
+        return points.Num();
+    }
+    
+    int32 awake = 0;
+    for (int32 chunk = 0; chunk < sleep.chunk_awake.Num(); ++chunk)
+    {
+        if (sleep.chunk_awake[chunk])
+        {
+            const int32 begin = chunk * sleep.chunk_points;
+            awake += FMath::Min(begin + sleep.chunk_points, points.Num()) - begin;
+        }
+    }
+    return awake;
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+#include "SpringKernel.h"
+#include "Collision.h"
+#include "Snapshot.h"
+#include "Plasticity.h"
+
+// points per work item, small enough that a chunk's front, back and force
+// streams stay resident in L2 while it is integrated
+#define SOLVER_CHUNK_POINTS 2048
+
+// consecutive steps below the sleep threshold before a point counts as resting
+#define SLEEP_STEPS 30
+
+enum Integrator_Type
+{
+    // position from the old velocity, then velocity, the original update
+    IntegratorType_ExplicitEuler = 0,
+    // velocity first, then position from the new velocity
+    IntegratorType_SymplecticEuler,
+    // drift half a step, kick with the midpoint force, drift again
+    IntegratorType_PositionVerlet,
+    // backward Euler, one linear solve per step, stable for stiff springs
+    IntegratorType_ImplicitEuler
+};
+
+struct Solver_Params
+{
+    float dt;
+    float k;
+    float damping;
+    
+    // implicit integrator only
+    int32 cg_max_iterations;
+    float cg_tolerance;
+    
+    // lattice stencil instead of the neighbour lists, requires a valid stencil
+    bool use_stencil;
+    // spring table instead of the neighbour lists whenever the stencil is not used
+    bool use_springs;
+    Simd_Isa isa;
+    bool verify_stencil;
+    
+    bool multithreaded;
+    
+    // let resting chunks sleep, a point rests once its velocity stays below
+    // sleep_threshold for SLEEP_STEPS steps
+    bool sleep;
+    float sleep_threshold;
+    
+    // contacts with the shapes of Solver_Input::world and between points,
+    // resolved after every step
+    Collision_Params collision;
+    
+    // yield and tearing after every step
+    Plastic_Params plastic;
+    
+    // captures the state after every step when set, owned by the caller
+    State_Recorder * recorder = nullptr;
+};
+
+// Inputs gathered on the game thread between two steps. They are applied at the
+// start of the next step instead of being written into the store directly, so
+// they never touch state a running step owns.
+struct Solver_Input
+{
+    void reset()
+    {
+        // clear only what was touched, the dense buffers are kept for the next step
+        for (int32 idx : impulse_points)
+        {
+            impulse_vel[idx] = FVector(0, 0, 0);
+            impulse_touched[idx] = false;
+        }
+        impulse_points.Reset();
+        grab_points.Reset();
+        has_grab_target = false;
+        for (int32 idx : correction_points)
+        {
+            correction_touched[idx] = false;
+        }
+        correction_points.Reset();
+        tear_springs.Reset();
+        world.reset();
+    }
+    
+    // accumulates a velocity change for a point of a store with num_points points
+    void add_impulse(int32 point, const FVector & delta_vel, int32 num_points)
+    {
+        if (impulse_vel.Num() != num_points)
+        {
+            impulse_vel.Init(FVector(0, 0, 0), num_points);
+            impulse_touched.Init(false, num_points);
+            impulse_points.Reset();
+        }
+        
+        impulse_vel[point] += delta_vel;
+        if (!impulse_touched[point])
+        {
+            impulse_touched[point] = true;
+            impulse_points.Add(point);
+        }
+    }
+    
+    // position a point is moved to before the step, the last one given wins
+    void add_correction(int32 point, const FVector & pos, int32 num_points)
+    {
+        if (correction_pos.Num() != num_points)
+        {
+            correction_pos.SetNumUninitialized(num_points);
+            correction_touched.Init(false, num_points);
+            correction_points.Reset();
+        }
+        
+        correction_pos[point] = pos;
+        if (!correction_touched[point])
+        {
+            correction_touched[point] = true;
+            correction_points.Add(point);
+        }
+    }
+    
+    // summed velocity change per point, non zero only at impulse_points
+    TArray<FVector> impulse_vel;
+    TArray<uint8> impulse_touched;
+    TArray<int32> impulse_points;
+    
+    // grabbed points are pulled towards grab_target once per step
+    TArray<int32> grab_points;
+    FVector grab_target;
+    bool has_grab_target = false;
+    
+    // positions from a server, valid only at correction_points
+    TArray<FVector> correction_pos;
+    TArray<uint8> correction_touched;
+    TArray<int32> correction_points;
+    
+    // springs torn on a server, torn here before the step unless they are already
+    TArray<int32> tear_springs;
+    
+    // shapes the points collide with during the steps of this input
+    Collision_World world;
+};
+
+void solver_apply_input(Particle_Store & points, const Solver_Input & input);
+
+bool solver_uses_stencil(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params);
+bool solver_uses_springs(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params);
+
+// Points per work item, rounded to whole X rows when the stencil is used.
+int32 solver_chunk_points(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params);
+
+// Runs body over [0, count) in chunks, on worker threads when multithreaded is set.
+void solver_parallel_chunks(int32 count, int32 chunk_points, bool multithreaded, TFunctionRef<void(int32 begin, int32 end)> body);
+
+// Runs body over the runs of points in [begin, end) that are not pinned.
+// Integration loops only ever see these runs instead of testing every point.
+void solver_free_runs(const Particle_Store & points, int32 begin, int32 end, TFunctionRef<void(int32 begin, int32 end)> body);
+
+// Sizes the sleep state for the chunk layout and decides which chunks are
+// simulated this step. With enabled unset every chunk is awake.
+void solver_prepare_sleep(Particle_Store & points, int32 chunk_points, bool enabled);
+
+// Returns true when the chunk [begin, end) rests this step. The first resting
+// step copies the front state into the back buffers and zeroes the velocity,
+// after that both buffers agree and the chunk costs nothing.
+bool solver_skip_resting_chunk(Particle_Store & points, int32 begin, int32 end);
+
+// Updates the resting counters of a chunk after its back buffers were written.
+void solver_update_resting(Particle_Store & points, const Solver_Params & params, int32 begin, int32 end);
+
+// Whole lattice part of a force evaluation, run after solver_prepare_sleep and
+// before the solver_forces_range calls of the same state. The spring table
+// applies every spring to both of its ends, which does not split into point
+// ranges, so it accumulates the force of every awake point here, a block of
+// springs per work item. The per point kernels have nothing to do here.
+void solver_forces_prepare(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params,
+                           const FVector * pos, const FVector * vel, float damping, FVector * force);
+
+// Spring and damping force for the state (pos, vel) of the points in
+// [begin, end), a range produced by solver_parallel_chunks. Nothing left to do
+// for the spring table.
+void solver_forces_range(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params,
+                         const FVector * pos, const FVector * vel, float damping, FVector * force, int32 begin, int32 end);
+
+// Both of the above for every point, chunked across workers.
+void solver_forces(const Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params,
+                   const FVector * pos, const FVector * vel, float damping, FVector * force);
+
+
+// Advances a store by one step of params.dt.
+//
+// Every point reads only the previous state (pos, vel) and writes the next one
+// into the back buffers (pos_next, vel_next), which are swapped in at the end.
+// The result therefore does not depend on iteration order, chunking or the
+// number of worker threads, and the back buffers hold the previous state
+// afterwards.
+class Integrator
+{
+public:
+    virtual ~Integrator() {}
+    
+    virtual Integrator_Type type() const = 0;
+    virtual void step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params) = 0;
+    
+    // drops anything cached for the previous lattice
+    virtual void reset() {}
+    
+    // scratch memory the integrator holds on to between steps
+    virtual SIZE_T allocated_size() const { return 0; }
+};
+
+class Explicit_Euler_Integrator : public Integrator
+{
+public:
+    virtual Integrator_Type type() const override { return IntegratorType_ExplicitEuler; }
+    virtual void step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params) override;
+};
+
+class Symplectic_Euler_Integrator : public Integrator
+{
+public:
+    virtual Integrator_Type type() const override { return IntegratorType_SymplecticEuler; }
+    virtual void step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params) override;
+};
+
+class Position_Verlet_Integrator : public Integrator
+{
+public:
+    virtual Integrator_Type type() const override { return IntegratorType_PositionVerlet; }
+    virtual void step(Particle_Store & points, const Lattice_Stencil & stencil, const Solver_Params & params) override;
+    virtual SIZE_T allocated_size() const override { return half.GetAllocatedSize(); }
+
+private:
+    // midpoint positions the force is evaluated at
+    TArray<FVector> half;
+};
+
+TUniquePtr<Integrator> make_integrator(Integrator_Type type);
+
+// Applies input, then runs substeps fixed steps of params.dt, each followed by
+// the collision pass, yield and tearing, and the capture into params.recorder.
+// The back buffers hold the state before the last substep afterwards.
+void solver_advance(Particle_Store & points, const Lattice_Stencil & stencil, Integrator & integrator, const Solver_Params & params, const Solver_Input & input, int32 substeps);
+
+// Blends the last two states, alpha = 0 is the previous and 1 the current one.
+// With only_changed set, points of resting chunks keep whatever out held.
+void solver_interpolate(const Particle_Store & points, float alpha, TArray<FVector> & out, bool only_changed);
+
+// Chunk needs to be written to the mesh, it moved since the last write or its
+// interpolated positions still change.
+bool solver_chunk_changed(const Particle_Store & points, int32 chunk);
+
+// Points simulated in the last step, every point before the first one.
+int32 solver_awake_points(const Particle_Store & points);
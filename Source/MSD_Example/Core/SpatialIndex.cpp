@@ -0,0 +1,277 @@
+#include "SpatialIndex.h"
+#include "MSDStats.h"
+
+
+static FIntVector cell_of(const FVector & p, float cell_size)
+{
+    return FIntVector(FMath::FloorToInt(p.X / cell_size), FMath::FloorToInt(p.Y / cell_size), FMath::FloorToInt(p.Z / cell_size));
+}
+
+static int32 bucket_of(const FIntVector & cell, int32 table_mask)
+{
+    const uint32 hash = ((uint32)cell.X * 73856093u) ^ ((uint32)cell.Y * 19349663u) ^ ((uint32)cell.Z * 83492791u);
+    return (int32)(hash & (uint32)table_mask);
+}
+
+static void fill_buckets(Spatial_Grid & grid)
+{
+    const int32 num_points = grid.point_cell.Num();
+    const int32 num_buckets = grid.table_mask + 1;
+    
+    grid.bucket_offsets.Reset();
+    grid.bucket_offsets.SetNumZeroed(num_buckets + 1);
+    for (const FIntVector & cell : grid.point_cell)
+    {
+        ++grid.bucket_offsets[bucket_of(cell, grid.table_mask) + 1];
+    }
+    for (int32 b = 0; b < num_buckets; ++b)
+    {
+        grid.bucket_offsets[b + 1] += grid.bucket_offsets[b];
+    }
+    
+    TArray<int32> cursor(grid.bucket_offsets.GetData(), num_buckets);
+    grid.bucket_points.SetNumUninitialized(num_points);
+    for (int32 idx = 0; idx < num_points; ++idx)
+    {
+        grid.bucket_points[cursor[bucket_of(grid.point_cell[idx], grid.table_mask)]++] = idx;
+    }
+}
+
+void spatial_build(Spatial_Grid & grid, const TArray<FVector> & positions, float cell_size)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_SpatialRefit);
+    const int32 num_points = positions.Num();
+    grid.cell_size = cell_size;
+    // about two buckets per point keeps the chains short
+    grid.table_mask = FMath::RoundUpToPowerOfTwo(FMath::Max(num_points * 2, 1)) - 1;
+    
+    grid.point_cell.SetNumUninitialized(num_points);
+    for (int32 idx = 0; idx < num_points; ++idx)
+    {
+        grid.point_cell[idx] = cell_of(positions[idx], cell_size);
+    }
+    fill_buckets(grid);
+}
+
+int32 spatial_refit(Spatial_Grid & grid, const TArray<FVector> & positions, const TArray<uint8> & chunk_changed, int32 chunk_points)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_SpatialRefit);
+    int32 moved = 0;
+    for (int32 chunk = 0; chunk < chunk_changed.Num(); ++chunk)
+    {
+        if (!chunk_changed[chunk])
+        {
+            continue;
+        }
+        
+        const int32 begin = chunk * chunk_points;
+        const int32 end = FMath::Min(begin + chunk_points, positions.Num());
+        for (int32 idx = begin; idx < end; ++idx)
+        {
+            const FIntVector cell = cell_of(positions[idx], grid.cell_size);
+            if (cell != grid.point_cell[idx])
+            {
+                grid.point_cell[idx] = cell;
+                ++moved;
+            }
+        }
+    }
+    
+    if (moved)
+    {
+        fill_buckets(grid);
+    }
+    return moved;
+}
+
+void spatial_query_radius(const Spatial_Grid & grid, const TArray<FVector> & positions, const FVector & center, float radius, TArray<int32> & result)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_SpatialQuery);
+    const int32 first = result.Num();
+    const float radius_sq = radius * radius;
+    const FIntVector lo = cell_of(center - FVector(radius), grid.cell_size);
+    const FIntVector hi = cell_of(center + FVector(radius), grid.cell_size);
+    
+    FIntVector cell;
+    for (cell.Z = lo.Z; cell.Z <= hi.Z; ++cell.Z)
+    {
+        for (cell.Y = lo.Y; cell.Y <= hi.Y; ++cell.Y)
+        {
+            for (cell.X = lo.X; cell.X <= hi.X; ++cell.X)
+            {
+                const int32 bucket = bucket_of(cell, grid.table_mask);
+                for (int32 i = grid.bucket_offsets[bucket]; i < grid.bucket_offsets[bucket + 1]; ++i)
+                {
+                    const int32 idx = grid.bucket_points[i];
+                    if (grid.point_cell[idx] == cell && FVector::DistSquared(positions[idx], center) < radius_sq)
+                    {
+                        result.Add(idx);
+                    }
+                }
+            }
+        }
+    }
+    
+    // same order the linear scan produced
+    Sort(result.GetData() + first, result.Num() - first);
+}
+
+int32 spatial_query_nearest(const Spatial_Grid & grid, const TArray<FVector> & positions, const FVector & center, float max_radius)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_SpatialQuery);
+    const FIntVector origin = cell_of(center, grid.cell_size);
+    const int32 max_ring = FMath::CeilToInt(max_radius / grid.cell_size);
+    
+    int32 best = INDEX_NONE;
+    float best_sq = max_radius * max_radius;
+    
+    // visit shells of cells around the center cell, every point beyond shell n
+    // is at least n cells away
+    for (int32 ring = 0; ring <= max_ring; ++ring)
+    {
+        const float reach = (ring - 1) * grid.cell_size;
+        if (best != INDEX_NONE && reach > 0 && reach * reach >= best_sq)
+        {
+            break;
+        }
+        
+        FIntVector d;
+        for (d.Z = -ring; d.Z <= ring; ++d.Z)
+        {
+            for (d.Y = -ring; d.Y <= ring; ++d.Y)
+            {
+                // rows inside the shell only touch it at both ends
+                const bool on_face = FMath::Abs(d.Z) == ring || FMath::Abs(d.Y) == ring;
+                const int32 step = on_face ? 1 : 2 * ring;
+                for (d.X = -ring; d.X <= ring; d.X += step)
+                {
+                    const FIntVector cell = origin + d;
+                    const int32 bucket = bucket_of(cell, grid.table_mask);
+                    for (int32 i = grid.bucket_offsets[bucket]; i < grid.bucket_offsets[bucket + 1]; ++i)
+                    {
+                        const int32 idx = grid.bucket_points[i];
+                        const float dist_sq = FVector::DistSquared(positions[idx], center);
+                        if (grid.point_cell[idx] == cell && (dist_sq < best_sq || (dist_sq == best_sq && best != INDEX_NONE && idx < best)))
+                        {
+                            best = idx;
+                            best_sq = dist_sq;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+static int32 dense_cell_axis(const Dense_Grid & grid, float value, int32 axis)
+{
+    return FMath::Clamp(FMath::FloorToInt(value / grid.cell_size), 0, grid.dims[axis] - 1);
+}
+
+bool dense_grid_build(Dense_Grid & grid, const TArray<FVector> & positions, float min_cell_size, int32 max_cells_per_point)
+{
+    const int32 num_points = positions.Num();
+    if (!num_points || !(min_cell_size > 0.0f))
+    {
+        grid.reset();
+        return num_points == 0;
+    }
+    
+    FVector lo = positions[0];
+    FVector hi = positions[0];
+    for (const FVector & p : positions)
+    {
+        if (!FMath::IsFinite(p.X) || !FMath::IsFinite(p.Y) || !FMath::IsFinite(p.Z))
+        {
+            grid.reset();
+            return false;
+        }
+        lo = lo.ComponentMin(p);
+        hi = hi.ComponentMax(p);
+    }
+    
+    // points far enough apart overflow the size as well
+    const FVector size = hi - lo;
+    if (!FMath::IsFinite(size.X) || !FMath::IsFinite(size.Y) || !FMath::IsFinite(size.Z))
+    {
+        grid.reset();
+        return false;
+    }
+    
+    // a body pulled far apart gets coarser cells instead of a huge table
+    const int32 max_cells = FMath::Max(num_points * max_cells_per_point, 1);
+    float cell_size = min_cell_size;
+    while ((size.X / cell_size + 1) * (size.Y / cell_size + 1) * (size.Z / cell_size + 1) > (float)max_cells)
+    {
+        cell_size *= 1.5f;
+    }
+    
+    grid.origin = lo;
+    grid.cell_size = cell_size;
+    // float rounding above may still leave one cell too many per axis
+    grid.dims.X = FMath::Clamp(FMath::FloorToInt(FMath::Min(size.X / cell_size, (float)max_cells)) + 1, 1, max_cells);
+    grid.dims.Y = FMath::Clamp(FMath::FloorToInt(FMath::Min(size.Y / cell_size, (float)max_cells)) + 1, 1, max_cells / grid.dims.X);
+    grid.dims.Z = FMath::Clamp(FMath::FloorToInt(FMath::Min(size.Z / cell_size, (float)max_cells)) + 1, 1, max_cells / (grid.dims.X * grid.dims.Y));
+    const int32 num_cells = grid.dims.X * grid.dims.Y * grid.dims.Z;
+    
+    grid.point_cell.SetNumUninitialized(num_points);
+    grid.cell_offsets.Reset();
+    grid.cell_offsets.SetNumZeroed(num_cells + 1);
+    for (int32 idx = 0; idx < num_points; ++idx)
+    {
+        const FVector local = positions[idx] - lo;
+        const int32 cell = dense_cell_axis(grid, local.X, 0) + grid.dims.X * (dense_cell_axis(grid, local.Y, 1) + grid.dims.Y * dense_cell_axis(grid, local.Z, 2));
+        grid.point_cell[idx] = cell;
+        ++grid.cell_offsets[cell + 1];
+    }
+    for (int32 cell = 0; cell < num_cells; ++cell)
+    {
+        grid.cell_offsets[cell + 1] += grid.cell_offsets[cell];
+    }
+    
+    // point_cell becomes the fill cursor of each point's cell, points stay in index order per cell
+    grid.cell_points.SetNumUninitialized(num_points);
+    TArray<int32> cursor(grid.cell_offsets.GetData(), num_cells);
+    for (int32 idx = 0; idx < num_points; ++idx)
+    {
+        grid.cell_points[cursor[grid.point_cell[idx]]++] = idx;
+    }
+    return true;
+}
+
+void dense_grid_gather(const Dense_Grid & grid, const TArray<FVector> & positions, const FVector & center, float radius, TArray<int32> & result)
+{
+    if (!grid.cell_offsets.Num())
+    {
+        return;
+    }
+    
+    const float radius_sq = radius * radius;
+    const FVector local = center - grid.origin;
+    const int32 x0 = dense_cell_axis(grid, local.X - radius, 0);
+    const int32 x1 = dense_cell_axis(grid, local.X + radius, 0);
+    const int32 y0 = dense_cell_axis(grid, local.Y - radius, 1);
+    const int32 y1 = dense_cell_axis(grid, local.Y + radius, 1);
+    const int32 z0 = dense_cell_axis(grid, local.Z - radius, 2);
+    const int32 z1 = dense_cell_axis(grid, local.Z + radius, 2);
+    
+    const int32 * offsets = grid.cell_offsets.GetData();
+    const int32 * cell_points = grid.cell_points.GetData();
+    const FVector * pos = positions.GetData();
+    for (int32 z = z0; z <= z1; ++z)
+    {
+        for (int32 y = y0; y <= y1; ++y)
+        {
+            // cells x0 .. x1 of the row are one range of cell_points
+            const int32 row = grid.dims.X * (y + grid.dims.Y * z);
+            for (int32 i = offsets[row + x0]; i < offsets[row + x1 + 1]; ++i)
+            {
+                if (FVector::DistSquared(pos[cell_points[i]], center) < radius_sq)
+                {
+                    result.Add(cell_points[i]);
+                }
+            }
+        }
+    }
+}
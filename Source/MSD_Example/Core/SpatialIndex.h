@@ -0,0 +1,87 @@
+#pragma once
+
+#include "MSDCore.h"
+
+// Uniform grid over the current point positions for grab and hit queries.
+//
+// Cells are cell_size wide and unbounded, they are hashed into a power of two
+// bucket table whose points are stored in compressed sparse row form: bucket b
+// holds bucket_points[bucket_offsets[b] .. bucket_offsets[b + 1]). Every point
+// remembers its cell, so cells sharing a bucket are told apart and a query
+// only visits the buckets of the cells it overlaps.
+struct Spatial_Grid
+{
+    void reset()
+    {
+        cell_size = 0;
+        table_mask = 0;
+        point_cell.Reset();
+        bucket_offsets.Reset();
+        bucket_points.Reset();
+    }
+    
+    bool is_valid_for(int32 num_points, float size) const
+    {
+        return num_points > 0 && point_cell.Num() == num_points && cell_size == size;
+    }
+    
+    float cell_size = 0;
+    int32 table_mask = 0;
+    
+    TArray<FIntVector> point_cell;
+    TArray<int32> bucket_offsets;
+    TArray<int32> bucket_points;
+};
+
+void spatial_build(Spatial_Grid & grid, const TArray<FVector> & positions, float cell_size);
+
+// Re-evaluates the cells of the points of changed chunks only, chunk_changed[c]
+// covering the points [c * chunk_points, (c + 1) * chunk_points). The buckets
+// are only rebuilt when a point actually left its cell. Returns the number of
+// points that did.
+int32 spatial_refit(Spatial_Grid & grid, const TArray<FVector> & positions, const TArray<uint8> & chunk_changed, int32 chunk_points);
+
+// Appends the points closer than radius to center in ascending index order.
+void spatial_query_radius(const Spatial_Grid & grid, const TArray<FVector> & positions, const FVector & center, float radius, TArray<int32> & result);
+
+// Closest point within max_radius of center, INDEX_NONE if there is none.
+int32 spatial_query_nearest(const Spatial_Grid & grid, const TArray<FVector> & positions, const FVector & center, float max_radius);
+
+// Uniform grid over the bounding box of the points, for passes that rebuild it
+// every step. Cells are numbered x fastest and their points stored in CSR
+// form, so the cells of one row are neighbours in cell_offsets and a query
+// reads a whole row of cell_points at once instead of one bucket per cell.
+// Cells are at least min_cell_size wide and grow when the box would need more
+// than max_cells_per_point cells per point.
+struct Dense_Grid
+{
+    void reset()
+    {
+        cell_size = 0;
+        dims = FIntVector(0, 0, 0);
+        cell_offsets.Reset();
+        cell_points.Reset();
+        point_cell.Reset();
+    }
+    
+    SIZE_T allocated_size() const
+    {
+        return cell_offsets.GetAllocatedSize() + cell_points.GetAllocatedSize() + point_cell.GetAllocatedSize();
+    }
+    
+    FVector origin = FVector(0, 0, 0);
+    float cell_size = 0;
+    FIntVector dims = FIntVector(0, 0, 0);
+    
+    TArray<int32> cell_offsets;
+    TArray<int32> cell_points;
+    // scratch of the build
+    TArray<int32> point_cell;
+};
+
+// False and an empty grid when a position is not finite, after a step that
+// diverged.
+bool dense_grid_build(Dense_Grid & grid, const TArray<FVector> & positions, float min_cell_size, int32 max_cells_per_point);
+
+// Appends the points closer than radius to center, in no particular order.
+void dense_grid_gather(const Dense_Grid & grid, const TArray<FVector> & positions, const FVector & center, float radius, TArray<int32> & result);
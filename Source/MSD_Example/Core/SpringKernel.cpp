@@ -0,0 +1,332 @@
+#include "SpringKernel.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+    #define MSD_SIMD_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define MSD_TARGET_AVX2
+    #else
+        #include <cpuid.h>
+        #define MSD_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #define MSD_SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+static_assert(sizeof(FVector) == 3 * sizeof(float), "stencil kernel walks FVector arrays as flat floats");
+
+enum Stencil_Dir
+{
+    StencilDir_MinusX = 1,
+    StencilDir_PlusX  = 2,
+    StencilDir_MinusY = 4,
+    StencilDir_PlusY  = 8,
+    StencilDir_MinusZ = 16,
+    StencilDir_PlusZ  = 32
+};
+
+// one run of floats sharing the same neighbour set
+struct Stencil_Run
+{
+    const float * p;
+    const float * v;
+    const float * r;
+    float * f;
+    int32 dy;
+    int32 dz;
+    uint32 mask;
+    float k;
+    float cd;
+};
+
+typedef void (*Stencil_Lanes)(const Stencil_Run & run, int32 begin, int32 end);
+
+
+static void stencil_lanes_scalar(const Stencil_Run & run, int32 begin, int32 end)
+{
+    for (int32 i = begin; i < end; ++i)
+    {
+        const float pc = run.p[i];
+        float sum = 0.0f;
+        if (run.mask & StencilDir_MinusX) sum = sum + (pc - run.p[i - 3]);
+        if (run.mask & StencilDir_PlusX)  sum = sum + (pc - run.p[i + 3]);
+        if (run.mask & StencilDir_MinusY) sum = sum + (pc - run.p[i - run.dy]);
+        if (run.mask & StencilDir_PlusY)  sum = sum + (pc - run.p[i + run.dy]);
+        if (run.mask & StencilDir_MinusZ) sum = sum + (pc - run.p[i - run.dz]);
+        if (run.mask & StencilDir_PlusZ)  sum = sum + (pc - run.p[i + run.dz]);
+
+        run.f[i] = (run.k * (run.r[i] - sum)) - (run.cd * run.v[i]);
+    }
+}
+
+#if MSD_SIMD_X86
+
+static void stencil_lanes_sse(const Stencil_Run & run, int32 begin, int32 end)
+{
+    const __m128 k = _mm_set1_ps(run.k);
+    const __m128 cd = _mm_set1_ps(run.cd);
+
+    int32 i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 pc = _mm_loadu_ps(run.p + i);
+        __m128 sum = _mm_setzero_ps();
+        if (run.mask & StencilDir_MinusX) sum = _mm_add_ps(sum, _mm_sub_ps(pc, _mm_loadu_ps(run.p + i - 3)));
+        if (run.mask & StencilDir_PlusX)  sum = _mm_add_ps(sum, _mm_sub_ps(pc, _mm_loadu_ps(run.p + i + 3)));
+        if (run.mask & StencilDir_MinusY) sum = _mm_add_ps(sum, _mm_sub_ps(pc, _mm_loadu_ps(run.p + i - run.dy)));
+        if (run.mask & StencilDir_PlusY)  sum = _mm_add_ps(sum, _mm_sub_ps(pc, _mm_loadu_ps(run.p + i + run.dy)));
+        if (run.mask & StencilDir_MinusZ) sum = _mm_add_ps(sum, _mm_sub_ps(pc, _mm_loadu_ps(run.p + i - run.dz)));
+        if (run.mask & StencilDir_PlusZ)  sum = _mm_add_ps(sum, _mm_sub_ps(pc, _mm_loadu_ps(run.p + i + run.dz)));
+
+        const __m128 spring = _mm_mul_ps(k, _mm_sub_ps(_mm_loadu_ps(run.r + i), sum));
+        _mm_storeu_ps(run.f + i, _mm_sub_ps(spring, _mm_mul_ps(cd, _mm_loadu_ps(run.v + i))));
+    }
+
+    stencil_lanes_scalar(run, i, end);
+}
+
+MSD_TARGET_AVX2 static void stencil_lanes_avx2(const Stencil_Run & run, int32 begin, int32 end)
+{
+    const __m256 k = _mm256_set1_ps(run.k);
+    const __m256 cd = _mm256_set1_ps(run.cd);
+
+    int32 i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 pc = _mm256_loadu_ps(run.p + i);
+        __m256 sum = _mm256_setzero_ps();
+        if (run.mask & StencilDir_MinusX) sum = _mm256_add_ps(sum, _mm256_sub_ps(pc, _mm256_loadu_ps(run.p + i - 3)));
+        if (run.mask & StencilDir_PlusX)  sum = _mm256_add_ps(sum, _mm256_sub_ps(pc, _mm256_loadu_ps(run.p + i + 3)));
+        if (run.mask & StencilDir_MinusY) sum = _mm256_add_ps(sum, _mm256_sub_ps(pc, _mm256_loadu_ps(run.p + i - run.dy)));
+        if (run.mask & StencilDir_PlusY)  sum = _mm256_add_ps(sum, _mm256_sub_ps(pc, _mm256_loadu_ps(run.p + i + run.dy)));
+        if (run.mask & StencilDir_MinusZ) sum = _mm256_add_ps(sum, _mm256_sub_ps(pc, _mm256_loadu_ps(run.p + i - run.dz)));
+        if (run.mask & StencilDir_PlusZ)  sum = _mm256_add_ps(sum, _mm256_sub_ps(pc, _mm256_loadu_ps(run.p + i + run.dz)));
+
+        const __m256 spring = _mm256_mul_ps(k, _mm256_sub_ps(_mm256_loadu_ps(run.r + i), sum));
+        _mm256_storeu_ps(run.f + i, _mm256_sub_ps(spring, _mm256_mul_ps(cd, _mm256_loadu_ps(run.v + i))));
+    }
+
+    stencil_lanes_scalar(run, i, end);
+}
+
+#if defined(_MSC_VER)
+static void msd_cpuid(int32 leaf, uint32 regs[4])
+{
+    int info[4];
+    __cpuidex(info, leaf, 0);
+    for (int32 i = 0; i < 4; ++i)
+    {
+        regs[i] = (uint32)info[i];
+    }
+}
+
+static uint64 msd_xgetbv()
+{
+    return _xgetbv(0);
+}
+#else
+static void msd_cpuid(int32 leaf, uint32 regs[4])
+{
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+}
+
+static uint64 msd_xgetbv()
+{
+    uint32 eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64)edx << 32) | eax;
+}
+#endif
+
+#endif // MSD_SIMD_X86
+
+#if MSD_SIMD_NEON
+
+static void stencil_lanes_neon(const Stencil_Run & run, int32 begin, int32 end)
+{
+    const float32x4_t k = vdupq_n_f32(run.k);
+    const float32x4_t cd = vdupq_n_f32(run.cd);
+
+    int32 i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        const float32x4_t pc = vld1q_f32(run.p + i);
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        if (run.mask & StencilDir_MinusX) sum = vaddq_f32(sum, vsubq_f32(pc, vld1q_f32(run.p + i - 3)));
+        if (run.mask & StencilDir_PlusX)  sum = vaddq_f32(sum, vsubq_f32(pc, vld1q_f32(run.p + i + 3)));
+        if (run.mask & StencilDir_MinusY) sum = vaddq_f32(sum, vsubq_f32(pc, vld1q_f32(run.p + i - run.dy)));
+        if (run.mask & StencilDir_PlusY)  sum = vaddq_f32(sum, vsubq_f32(pc, vld1q_f32(run.p + i + run.dy)));
+        if (run.mask & StencilDir_MinusZ) sum = vaddq_f32(sum, vsubq_f32(pc, vld1q_f32(run.p + i - run.dz)));
+        if (run.mask & StencilDir_PlusZ)  sum = vaddq_f32(sum, vsubq_f32(pc, vld1q_f32(run.p + i + run.dz)));
+
+        // separate mul and sub, a fused multiply-add would round differently from the scalar path
+        const float32x4_t spring = vmulq_f32(k, vsubq_f32(vld1q_f32(run.r + i), sum));
+        vst1q_f32(run.f + i, vsubq_f32(spring, vmulq_f32(cd, vld1q_f32(run.v + i))));
+    }
+
+    stencil_lanes_scalar(run, i, end);
+}
+
+#endif // MSD_SIMD_NEON
+
+
+static Simd_Isa detect_simd_isa()
+{
+#if MSD_SIMD_X86
+    uint32 regs[4];
+    msd_cpuid(0, regs);
+    const uint32 max_leaf = regs[0];
+
+    msd_cpuid(1, regs);
+    const bool os_xsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+
+    if (max_leaf >= 7 && os_xsave && avx && (msd_xgetbv() & 6) == 6)
+    {
+        msd_cpuid(7, regs);
+        if (regs[1] & (1 << 5))
+        {
+            return SimdIsa_AVX2;
+        }
+    }
+    return SimdIsa_SSE;
+#elif MSD_SIMD_NEON
+    return SimdIsa_NEON;
+#else
+    return SimdIsa_Scalar;
+#endif
+}
+
+Simd_Isa best_simd_isa()
+{
+    static const Simd_Isa isa = detect_simd_isa();
+    return isa;
+}
+
+const TCHAR * simd_isa_name(Simd_Isa isa)
+{
+    switch (isa)
+    {
+        case SimdIsa_SSE:  return TEXT("SSE");
+        case SimdIsa_AVX2: return TEXT("AVX2");
+        case SimdIsa_NEON: return TEXT("NEON");
+        default:           return TEXT("Scalar");
+    }
+}
+
+static Stencil_Lanes get_stencil_lanes(Simd_Isa isa)
+{
+    switch (isa)
+    {
+#if MSD_SIMD_X86
+        case SimdIsa_SSE:  return &stencil_lanes_sse;
+        case SimdIsa_AVX2: return &stencil_lanes_avx2;
+#endif
+#if MSD_SIMD_NEON
+        case SimdIsa_NEON: return &stencil_lanes_neon;
+#endif
+        default:           return &stencil_lanes_scalar;
+    }
+}
+
+static int32 count_bits(uint32 mask)
+{
+    int32 count = 0;
+    for (; mask; mask &= mask - 1)
+    {
+        ++count;
+    }
+    return count;
+}
+
+
+void build_stencil(Lattice_Stencil & stencil, const Lattice_Topology & lattice, FVector size)
+{
+    stencil.size = FIntVector(FMath::RoundToInt(size.X), FMath::RoundToInt(size.Y), FMath::RoundToInt(size.Z));
+    if (stencil.size.X * stencil.size.Y * stencil.size.Z != lattice.Num() || !lattice.axis_springs_only)
+    {
+        // hollow lattices are not a full grid and shear or bend springs are
+        // not in the stencil, both go through the spring table instead
+        stencil.reset();
+        return;
+    }
+    stencil.rest_sum.SetNumUninitialized(lattice.Num());
+
+    for (int32 idx = 0; idx < lattice.Num(); ++idx)
+    {
+        FVector sum(0, 0, 0);
+        for (int32 i = lattice.neighbour_offsets[idx]; i < lattice.neighbour_offsets[idx + 1]; ++i)
+        {
+            sum += lattice.rest[idx] - lattice.rest[lattice.neighbour_list[i]];
+        }
+        stencil.rest_sum[idx] = sum;
+    }
+}
+
+void stencil_forces(const Lattice_Stencil & stencil, const FVector * pos, const FVector * vel, float k, float damping, FVector * force, Simd_Isa isa)
+{
+    stencil_forces(stencil, pos, vel, k, damping, force, isa, 0, stencil.num_rows());
+}
+
+void stencil_forces(const Lattice_Stencil & stencil, const FVector * pos, const FVector * vel, float k, float damping, FVector * force, Simd_Isa isa, int32 row_begin, int32 row_end)
+{
+    const FIntVector size = stencil.size;
+    const Stencil_Lanes lanes = get_stencil_lanes(isa);
+
+    Stencil_Run run;
+    run.p = (const float *)pos;
+    run.v = (const float *)vel;
+    run.r = (const float *)stencil.rest_sum.GetData();
+    run.f = (float *)force;
+    run.dy = 3 * size.X;
+    run.dz = 3 * size.X * size.Y;
+    run.k = k;
+
+    for (int32 row_index = row_begin; row_index < row_end; ++row_index)
+    {
+        const int32 y = row_index % size.Y;
+        const int32 z = row_index / size.Y;
+        uint32 row_mask = 0;
+        row_mask |= (y > 0) ? StencilDir_MinusY : 0;
+        row_mask |= (y < size.Y - 1) ? StencilDir_PlusY : 0;
+        row_mask |= (z > 0) ? StencilDir_MinusZ : 0;
+        row_mask |= (z < size.Z - 1) ? StencilDir_PlusZ : 0;
+
+        const int32 row = 3 * row_index * size.X;
+
+        // the two ends of the row miss one x neighbour and always take the scalar path
+        run.mask = row_mask | ((size.X > 1) ? StencilDir_PlusX : 0);
+        run.cd = count_bits(run.mask) * damping;
+        stencil_lanes_scalar(run, row, row + 3);
+
+        if (size.X > 1)
+        {
+            run.mask = row_mask | StencilDir_MinusX;
+            run.cd = count_bits(run.mask) * damping;
+            stencil_lanes_scalar(run, row + 3 * (size.X - 1), row + 3 * size.X);
+        }
+
+        if (size.X > 2)
+        {
+            run.mask = row_mask | StencilDir_MinusX | StencilDir_PlusX;
+            run.cd = count_bits(run.mask) * damping;
+            lanes(run, row + 3, row + 3 * (size.X - 1));
+        }
+    }
+}
+
+float stencil_verify(const Lattice_Stencil & stencil, const FVector * pos, const FVector * vel, float k, float damping, const FVector * force)
+{
+    TArray<FVector> reference;
+    reference.SetNumUninitialized(stencil.rest_sum.Num());
+    stencil_forces(stencil, pos, vel, k, damping, reference.GetData(), SimdIsa_Scalar);
+
+    float max_error = 0.0f;
+    for (int32 idx = 0; idx < reference.Num(); ++idx)
+    {
+        max_error = FMath::Max(max_error, (reference[idx] - force[idx]).GetAbs().GetMax());
+    }
+    return max_error;
+}
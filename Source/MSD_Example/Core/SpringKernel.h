@@ -0,0 +1,61 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+
+// Spring force kernel for the regular lattice built by generateMesh.
+//
+// Every mass point has at most six neighbours at fixed index offsets
+// (+-1, +-size.X, +-size.X * size.Y), so the force pass can walk each X row as
+// a flat run of floats and evaluate several lanes at once:
+//
+//   F = k * (rest_sum - sum(p - n)) - count * damping * v
+//
+// rest_sum is the per point sum of spring rest offsets, precomputed once. All
+// instruction sets evaluate the exact same sequence of operations per float so
+// the SIMD paths agree with the scalar fallback up to rounding.
+
+enum Simd_Isa
+{
+    SimdIsa_Scalar = 0,
+    SimdIsa_SSE,
+    SimdIsa_AVX2,
+    SimdIsa_NEON
+};
+
+// widest instruction set supported by the running CPU, detected once
+Simd_Isa best_simd_isa();
+const TCHAR * simd_isa_name(Simd_Isa isa);
+
+struct Lattice_Stencil
+{
+    void reset()
+    {
+        size = FIntVector(0, 0, 0);
+        rest_sum.Reset();
+    }
+
+    bool is_valid_for(const Particle_Store & points) const
+    {
+        return size.X * size.Y * size.Z == points.Num() && rest_sum.Num() == points.Num();
+    }
+    
+    // X rows, indexed z * size.Y + y
+    int32 num_rows() const { return size.Y * size.Z; }
+    
+    SIZE_T allocated_size() const { return rest_sum.GetAllocatedSize(); }
+
+    FIntVector size;
+    TArray<FVector> rest_sum;
+};
+
+void build_stencil(Lattice_Stencil & stencil, const Lattice_Topology & lattice, FVector size);
+
+// writes the spring and damping force of every point for the state (pos, vel) into force
+void stencil_forces(const Lattice_Stencil & stencil, const FVector * pos, const FVector * vel, float k, float damping, FVector * force, Simd_Isa isa);
+
+// same for the points of rows [row_begin, row_end) only
+void stencil_forces(const Lattice_Stencil & stencil, const FVector * pos, const FVector * vel, float k, float damping, FVector * force, Simd_Isa isa, int32 row_begin, int32 row_end);
+
+// largest per component difference between force and the scalar reference
+float stencil_verify(const Lattice_Stencil & stencil, const FVector * pos, const FVector * vel, float k, float damping, const FVector * force);
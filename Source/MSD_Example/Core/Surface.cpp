@@ -0,0 +1,101 @@
+#include "Surface.h"
+#include "Solver.h"
+#include "MSDStats.h"
+
+// render vertices per work item
+#define SURFACE_CHUNK_VERTICES 4096
+
+
+int32 surface_recompute_normals(const Surface_Topology & surface, Surface_Normals & result, const TArray<int32> & triangles, const TArray<FVector> & positions,
+                                const TArray<uint8> & chunk_changed, int32 chunk_points, bool multithreaded)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_Normals);
+    const int32 num_vertices = surface.Num();
+    result.normal.SetNum(num_vertices);
+    result.tangent.SetNum(num_vertices);
+    result.dirty.SetNum(num_vertices);
+    
+    const FVector * pos = positions.GetData();
+    const int32 * vertex_point = surface.vertex_point.GetData();
+    const int32 * triangle_offsets = surface.triangle_offsets.GetData();
+    const int32 * triangle_list = surface.triangle_list.GetData();
+    const int32 * tris = triangles.GetData();
+    const uint8 * changed = chunk_changed.GetData();
+    
+    const int32 num_work = FMath::DivideAndRoundUp(num_vertices, SURFACE_CHUNK_VERTICES);
+    TArray<int32> work_count;
+    work_count.SetNumZeroed(num_work);
+    
+    solver_parallel_chunks(num_vertices, SURFACE_CHUNK_VERTICES, multithreaded, [&](int32 begin, int32 end)
+    {
+        int32 count = 0;
+        for (int32 v = begin; v < end; ++v)
+        {
+            const int32 tri_begin = triangle_offsets[v];
+            const int32 tri_end = triangle_offsets[v + 1];
+            
+            // the normal changes when any corner of the surrounding triangles moved
+            bool moved = false;
+            for (int32 t = tri_begin; t < tri_end && !moved; ++t)
+            {
+                const int32 * tri = tris + triangle_list[t];
+                moved = changed[vertex_point[tri[0]] / chunk_points]
+                    || changed[vertex_point[tri[1]] / chunk_points]
+                    || changed[vertex_point[tri[2]] / chunk_points];
+            }
+            
+            result.dirty[v] = moved;
+            if (!moved)
+            {
+                continue;
+            }
+            
+            FVector normal(0, 0, 0);
+            for (int32 t = tri_begin; t < tri_end; ++t)
+            {
+                const int32 * tri = tris + triangle_list[t];
+                const FVector p0 = pos[vertex_point[tri[0]]];
+                const FVector p1 = pos[vertex_point[tri[1]]];
+                const FVector p2 = pos[vertex_point[tri[2]]];
+                // twice the area, pointing out of the front face
+                normal += FVector::CrossProduct(p2 - p0, p1 - p0);
+            }
+            normal = normal.GetSafeNormal();
+            
+            const FVector & rest_tangent = surface.rest_tangent[v];
+            result.normal[v] = normal;
+            result.tangent[v] = (rest_tangent - normal * FVector::DotProduct(rest_tangent, normal)).GetSafeNormal();
+            ++count;
+        }
+        work_count[begin / SURFACE_CHUNK_VERTICES] = count;
+    });
+    
+    int32 total = 0;
+    for (int32 count : work_count)
+    {
+        total += count;
+    }
+    return total;
+}
+
+void surface_spring_triangles(const Surface_Topology & surface, const Lattice_Topology & lattice, const TArray<int32> & triangles, int32 s, TArray<int32> & result)
+{
+    const int32 a = lattice.spring_a[s];
+    const int32 b = lattice.spring_b[s];
+    for (int32 i = lattice.vertex_offsets[a]; i < lattice.vertex_offsets[a + 1]; ++i)
+    {
+        const int32 v = lattice.vertex_list[i];
+        for (int32 t = surface.triangle_offsets[v]; t < surface.triangle_offsets[v + 1]; ++t)
+        {
+            const int32 first = surface.triangle_list[t];
+            for (int32 corner = 0; corner < 3; ++corner)
+            {
+                if (surface.vertex_point[triangles[first + corner]] == b)
+                {
+                    result.Add(first);
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "MSDCore.h"
+#include "Generator.h"
+
+// Deformed normals of one body over a shared Surface_Topology.
+struct Surface_Normals
+{
+    void reset()
+    {
+        normal.Reset();
+        tangent.Reset();
+        dirty.Reset();
+    }
+    
+    // results of the last recompute, valid where dirty is set
+    TArray<FVector> normal;
+    TArray<FVector> tangent;
+    TArray<uint8> dirty;
+    
+    SIZE_T allocated_size() const
+    {
+        return normal.GetAllocatedSize() + tangent.GetAllocatedSize() + dirty.GetAllocatedSize();
+    }
+};
+
+// Recomputes the normal and tangent of every render vertex whose triangles
+// touch a point of a changed chunk, chunk_changed[c] covering the points
+// [c * chunk_points, (c + 1) * chunk_points). Vertex normals are the area
+// weighted sum of the normals of their triangles, tangents are the generation
+// tangents re-orthogonalised against them.
+//
+// Every vertex only reads positions and writes its own entries of
+// result.normal, result.tangent and result.dirty, so vertex ranges run in
+// parallel without synchronisation. Returns the number of vertices recomputed.
+int32 surface_recompute_normals(const Surface_Topology & surface, Surface_Normals & result, const TArray<int32> & triangles, const TArray<FVector> & positions,
+                                const TArray<uint8> & chunk_changed, int32 chunk_points, bool multithreaded);
+
+// Appends the first index in triangles of every triangle that has a vertex of
+// each end of spring s, the faces a torn spring splits. Visits only the
+// triangles around the vertices of the spring's first point, a triangle split
+// by several springs is appended once for each.
+void surface_spring_triangles(const Surface_Topology & surface, const Lattice_Topology & lattice, const TArray<int32> & triangles, int32 s, TArray<int32> & result);
@@ -9,8 +9,18 @@
 #include "RuntimeMeshBuilder.h"
 #include "RuntimeMeshData.h"
 #include "RuntimeMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "Core/MSDStats.h"
+#include "MSDLatticeAsset.h"
+#include "MSDManager.h"
+#include "PhysicsEngine/BodySetup.h"
 
-#include "Generator.cpp"
+
+static TAutoConsoleVariable<int32> CVarMSDVerifyStencil(
+    TEXT("msd.VerifyStencil"),
+    0,
+    TEXT("Compare the SIMD lattice stencil against the scalar reference every step and log mismatches."),
+    ECVF_Cheat);
 
 
 AMSDActor::AMSDActor(const FObjectInitializer& ObjectInitializer)
@@ -24,7 +34,66 @@ AMSDActor::AMSDActor(const FObjectInitializer& ObjectInitializer)
     mass = 20.0f;
     k = 50.0f;
     damping = 10.0f;
-    frame_counter = 0;
+    spring_kernel = EMSDSpringKernel::StencilSIMD;
+    integrator = EMSDIntegrator::SymplecticEuler;
+    surface_mode = EMSDSurfaceMode::SharedFaces;
+    shell_layers = 0;
+    shear_stiffness = 0.0f;
+    bend_stiffness = 0.0f;
+    lattice_asset = nullptr;
+    
+    FMSDMaterial anchors;
+    anchors.Sides = (int32)EMSDCubeSide::Top;
+    anchors.bPinned = true;
+    materials.Add(anchors);
+    
+    bRecomputeNormals = false;
+    cg_max_iterations = 20;
+    cg_tolerance = 1e-3f;
+    bMultithreadedSolver = true;
+    bAllowSleep = true;
+    sleep_threshold = 0.05f;
+    bWorldCollision = false;
+    bSelfCollision = false;
+    collision_thickness = 0.25f;
+    collision_friction = 0.3f;
+    yield_strain = 0.0f;
+    creep_rate = 1.0f;
+    break_strain = 0.0f;
+    record_steps = 0;
+    snapshot_precision = 0.01f;
+    bCollisionProxy = false;
+    collision_proxy_blocks = 2;
+    collision_proxy_tolerance = 0.5f;
+    fixed_dt = 1.0f / 60.0f;
+    max_substeps = 4;
+    bAsyncSimulation = false;
+    bManaged = false;
+    bReplicates = false;
+    bReplicateDeformation = false;
+    replication_bytes_per_second = 8000;
+    keyframe_interval = 0.1f;
+    replication_error = 0.5f;
+    scheduled = false;
+    starved_frames = 0;
+    last_active_time = -1e9f;
+    report_point_steps = 0;
+    report_seconds = 0;
+    task_point_steps = 0;
+    task_seconds = 0;
+    sim_accumulator = 0;
+    render_chunk_points = 0;
+    step_integrator = nullptr;
+    step_substeps = 0;
+    step_alpha = 0;
+    awake_points = 0;
+    spatial_source = nullptr;
+    replaying = false;
+    replay_time = 0;
+    replay_frame = INDEX_NONE;
+    keyframe_timer = 0;
+    keyframe_sequence = 0;
+    has_keyframe = false;
     dt = 0;
     
     
@@ -36,7 +105,7 @@ AMSDActor::AMSDActor(const FObjectInitializer& ObjectInitializer)
     
     RuntimeMesh = CreateDefaultSubobject<URuntimeMeshComponent>(TEXT("MSD Mesh"));
 	RuntimeMesh->SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
-	
+
 #if ENGINE_MAJOR_VERSION >= 4 && ENGINE_MINOR_VERSION >= 20
 	RuntimeMesh->SetGenerateOverlapEvents(false);
 #else
@@ -44,6 +113,8 @@ AMSDActor::AMSDActor(const FObjectInitializer& ObjectInitializer)
 #endif
     RuntimeMesh->SetCollisionUseComplexAsSimple(false);
     RuntimeMesh->SetMeshSectionCollisionEnabled(0, false);
+    // the render section never collides, the proxy hulls cook off the game thread
+    RuntimeMesh->SetCollisionUseAsyncCooking(true);
     
     //RuntimeMesh->SetSimulatePhysics(true);
  }
@@ -54,7 +125,7 @@ void AMSDActor::BeginPlay()
     
     RuntimeMesh->AttachToComponent(Root, FAttachmentTransformRules::KeepWorldTransform);
     bool bIsGameWorld = GetWorld() && GetWorld()->IsGameWorld() && !GetWorld()->IsPreviewWorld() && !GetWorld()->IsEditorWorld();
-    
+
 	bool bHadSerializedMeshData = false;
 	if (RuntimeMesh)
 	{
@@ -64,11 +135,33 @@ void AMSDActor::BeginPlay()
 			bHadSerializedMeshData = Mesh->ShouldSerializeMeshData();
 		}
 	}
-    
+
 	if ((bIsGameWorld && !bHadSerializedMeshData) || bRunGenerateMeshesOnBeginPlay)
 	{
     	GenerateMeshes();
 	}
+
+    if (bManaged)
+    {
+        manager = AMSDManager::Get(GetWorld());
+        if (manager.IsValid())
+        {
+            manager->register_body(this);
+            AddTickPrerequisiteActor(manager.Get());
+        }
+    }
+}
+
+void AMSDActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    wait_for_simulation();
+    if (manager.IsValid())
+    {
+        manager->unregister_body(this);
+    }
+    manager = nullptr;
+    scheduled = false;
+    Super::EndPlay(EndPlayReason);
 }
 
 void AMSDActor::OnConstruction(const FTransform& Transform)
@@ -82,6 +175,17 @@ void AMSDActor::OnConstruction(const FTransform& Transform)
 #define debugTime 10.0f
 void AMSDActor::GenerateMeshes_Implementation()
 {
+    if (lattice_asset && lattice_asset->IsBuilt())
+    {
+        // the asset's lattice replaces the actor's own parameters
+        dimension = lattice_asset->dimension;
+        grid_size = lattice_asset->grid_size;
+        surface_mode = lattice_asset->surface_mode;
+        shell_layers = lattice_asset->shell_layers;
+        shear_stiffness = lattice_asset->shear_stiffness;
+        bend_stiffness = lattice_asset->bend_stiffness;
+    }
+    
     if (dimension.X <= 0 || dimension.Y <= 0 || dimension.Z <= 0 || grid_size <= 0)
     {
         if (GEngine) {
@@ -100,15 +204,109 @@ void AMSDActor::GenerateMeshes_Implementation()
         dimension = lastDimension;
         return;
     }
-
+    
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_Generate);
+    wait_for_simulation();
+    pending_input.reset();
+    sim_accumulator = 0;
     
     FRuntimeMeshDataPtr Data = RuntimeMesh->GetOrCreateRuntimeMesh()->GetRuntimeMeshData();
-    Data->CreateMeshSection(0, false, false, 1, false, true, EUpdateFrequency::Average);
+    // kept for update_section, which runs every frame
+    mesh_data = Data;
+    const Lattice_Key key = make_lattice_key(dimension, grid_size, (Surface_Mode)surface_mode, shell_layers, shear_stiffness, bend_stiffness);
     
-    auto Section = Data->BeginSectionUpdate(0);
-    generateMesh(mesh_section, dimension, grid_size, mass, k, damping, *Section.Get());
-    UE_LOG(LogTemp, Warning, TEXT("genereted verts: %d, tris: %d, mass points: %d"), Section->NumVertices(), Section->NumIndices(), mesh_section.points.Num());
-    Section->Commit();
+    if (lattice.IsValid() && lattice->key == key && Data->DoesSectionExist(0))
+    {
+        // only mass, material, k or damping changed: k and damping are read
+        // every step, the lattice goes back to rest with the new material and
+        // the static streams stay as they are
+        reset_to_rest(points);
+        apply_material(points, mass, make_material_paints());
+        
+        auto Section = Data->BeginSectionUpdate(0);
+        const Mesh_Section & mesh = lattice->mesh;
+        for (int32 v = 0; v < mesh.vertices.Num(); ++v)
+        {
+            Section->SetPosition(v, mesh.vertices[v]);
+            Section->SetNormalTangent(v, mesh.surface.rest_normal[v], FRuntimeMeshTangent(mesh.surface.rest_tangent[v]));
+        }
+        // the faces torn springs hid come back with the healed springs
+        for (int32 first : hidden_triangles)
+        {
+            for (int32 corner = 0; corner < 3; ++corner)
+            {
+                Section->SetIndex(first + corner, mesh.triangles[first + corner]);
+            }
+        }
+        Section->Commit(true, true, false, false, hidden_triangles.Num() > 0);
+    }
+    else
+    {
+        if (!Data->DoesSectionExist(0))
+        {
+            // positions are rewritten every frame, the other streams only here
+            Data->CreateMeshSection(0, false, false, 1, false, true, EUpdateFrequency::Frequent);
+        }
+        
+        // shared with every other body of the same lattice, only built if
+        // there is none yet, into the buffers of the old one if no other body
+        // shares that
+        lattice = lattice_asset && lattice_asset->IsBuilt() ? lattice_asset->Acquire() : lattice_cache_acquire(key, lattice);
+        init_particles(points, lattice->mesh.lattice, mass);
+        apply_material(points, mass, make_material_paints());
+        surface_normals.reset();
+        
+        // the existing section keeps its buffers, they are only refilled
+        auto Section = Data->BeginSectionUpdate(0);
+        const Mesh_Section & mesh = lattice->mesh;
+        Section->EmptyVertices(mesh.vertices.Num());
+        Section->EmptyIndices(mesh.triangles.Num());
+        for (int32 v = 0; v < mesh.vertices.Num(); ++v)
+        {
+            Section->AddVertex(mesh.vertices[v]);
+            Section->SetNormalTangent(v, mesh.surface.rest_normal[v], FRuntimeMeshTangent(mesh.surface.rest_tangent[v]));
+            Section->SetUV(v, mesh.surface.uv[v]);
+        }
+        for (int32 index : mesh.triangles)
+        {
+            Section->AddIndex(index);
+        }
+        
+        UE_LOG(LogTemp, Log, TEXT("genereted verts: %d, tris: %d, mass points: %d"), Section->NumVertices(), Section->NumIndices(), points.Num());
+        Section->Commit();
+    }
+    
+    published_pos = points.pos;
+    awake_points = published_pos.Num();
+    spatial_index.reset();
+    
+    published_torn.Reset();
+    hidden_triangles.Reset();
+    shown_torn.Reset();
+    
+    // recorded steps and keyframes belong to the old lattice, the keyframe
+    // sequence goes on so clients take the new body's keyframes
+    replaying = false;
+    recorder.reset(record_steps);
+    keyframe_state.reset();
+    has_keyframe = false;
+    
+    // cooked from the rest pose by the first update
+    collision_proxy.reset();
+    if (bCollisionProxy)
+    {
+        proxy_build(collision_proxy, points.topology->rest, grid_size, collision_proxy_blocks);
+    }
+    if (!collision_proxy.num_hulls())
+    {
+        RuntimeMesh->ClearCollisionConvexMeshes();
+    }
+    update_collision_proxy(published_pos);
+    if (solver_integrator)
+    {
+        solver_integrator->reset();
+    }
     
     lastDimension = dimension;
 }
@@ -122,105 +320,393 @@ void AMSDActor::OnOverlap_Implementation(AActor* OverlappedActor, AActor* OtherA
 void AMSDActor::Tick(float DeltaTime)
 {
     Super::Tick(DeltaTime);
-    ++frame_counter;
-    if (frame_counter < 3 || !mesh_section.points.Num())
+    if (prepare_step(DeltaTime))
     {
-        return;
+        run_step(bMultithreadedSolver);
+        finish_step();
+    }
+}
+
+bool AMSDActor::prepare_step(float DeltaTime)
+{
+    // published_pos is sized at generation and never touched by a running step
+    if (!published_pos.Num() || fixed_dt <= 0.0f)
+    {
+        return false;
     }
     
-    DeltaTime = (frame_counter + 1) * DeltaTime;
-    frame_counter = 0;
-    FVector g = FVector(0, 0, -9.8);
+    MSD_ADD_COUNTER(STAT_MSD_TotalPoints, published_pos.Num());
+    MSD_ADD_COUNTER(STAT_MSD_ActivePoints, awake_points);
+    MSD_ADD_COUNTER(STAT_MSD_SleepingPoints, published_pos.Num() - awake_points);
     
-    FRuntimeMeshDataPtr Data = RuntimeMesh->GetOrCreateRuntimeMesh()->GetRuntimeMeshData();
-    auto Section = Data->BeginSectionUpdate(0);
+    sim_accumulator += DeltaTime;
+    send_keyframe(DeltaTime);
+    
+    if (scheduled && schedule.lod == BodyLod_Asleep)
+    {
+        // nothing moves or uploads until the manager wakes the body, the time is dropped
+        scheduled = false;
+        sim_accumulator = 0;
+        return false;
+    }
+    
+    if (replaying)
+    {
+        tick_replay(DeltaTime);
+        return false;
+    }
+    
+    gather_collision_world();
+    
+    if (bAsyncSimulation)
+    {
+        tick_async();
+        return false;
+    }
+    
+    wait_for_simulation();
+    step_integrator = &get_integrator();
+    step_params = make_solver_params();
+    step_substeps = consume_substeps();
+    step_alpha = sim_accumulator / fixed_dt;
+    return true;
+}
+
+void AMSDActor::run_step(bool multithreaded)
+{
+    Solver_Params params = step_params;
+    params.multithreaded &= multithreaded;
+    
+    const double start = FPlatformTime::Seconds();
+    solver_advance(points, lattice->stencil, *step_integrator, params, pending_input, step_substeps);
+    report_seconds += FPlatformTime::Seconds() - start;
+    report_point_steps += (int64)awake_points * step_substeps;
+    pending_input.reset();
+    awake_points = solver_awake_points(points);
     
-    //int anchorIdx = 0;
-    FVector center = (mesh_section.size - 1)  / 2;
-    int centerIdx = calc(center, mesh_section.size);
-    int anchorIdx = (int)(mesh_section.points.Num() / 2);
+    solver_interpolate(points, step_alpha, render_pos, true);
+}
+
+void AMSDActor::finish_step()
+{
+    update_section(render_pos);
+    update_spatial_index();
+    update_collision_proxy(render_pos);
+    publish_torn();
+}
+
+Body_Schedule_Input AMSDActor::make_schedule_input(float DeltaTime) const
+{
+    Body_Schedule_Input input;
+    input.points = awake_points;
+    // before the manager's limit, what the time of this frame adds up to
+    input.wanted_steps = fixed_dt > 0.0f ? FMath::Min(FMath::FloorToInt((sim_accumulator + DeltaTime) / fixed_dt), max_substeps) : 0;
+    input.resting = bAllowSleep && published_pos.Num() > 0 && awake_points == 0;
+    input.seconds_since_active = GetWorld()->GetTimeSeconds() - last_active_time;
+    input.starved_frames = starved_frames;
+    return input;
+}
+
+void AMSDActor::set_schedule(const Body_Schedule & new_schedule)
+{
+    schedule = new_schedule;
+    scheduled = true;
+    // frames between two turns of a throttled body neither raise nor reset the count
+    starved_frames = schedule.starved ? starved_frames + 1 : (schedule.steps > 0 ? 0 : starved_frames);
+}
+
+void AMSDActor::take_step_report(int64 & point_steps, double & seconds)
+{
+    point_steps += report_point_steps;
+    seconds += report_seconds;
+    report_point_steps = 0;
+    report_seconds = 0;
+}
+
+void AMSDActor::mark_active()
+{
+    last_active_time = GetWorld() ? GetWorld()->GetTimeSeconds() : 0.0f;
+}
+
+TArray<Material_Paint> AMSDActor::make_material_paints() const
+{
+    TArray<Material_Paint> paints;
+    for (const FMSDMaterial & material : materials)
+    {
+        Material_Paint paint;
+        paint.side_mask = (uint8)material.Sides;
+        paint.use_box = material.bUseBox;
+        paint.box_min = material.Box.Min;
+        paint.box_max = material.Box.Max;
+        paint.mass_scale = FMath::Max(material.MassScale, 0.001f);
+        paint.stiffness_scale = FMath::Max(material.StiffnessScale, 0.0f);
+        paint.damping_scale = FMath::Max(material.DampingScale, 0.0f);
+        paint.pinned = material.bPinned;
+        paints.Add(paint);
+    }
+    return paints;
+}
+
+Solver_Params AMSDActor::make_solver_params()
+{
+    Solver_Params params;
+    params.dt = fixed_dt;
+    params.k = k;
+    params.damping = damping;
+    params.cg_max_iterations = cg_max_iterations;
+    params.cg_tolerance = cg_tolerance;
+    params.use_stencil = spring_kernel == EMSDSpringKernel::StencilScalar || spring_kernel == EMSDSpringKernel::StencilSIMD;
+    params.use_springs = spring_kernel != EMSDSpringKernel::Neighbours;
+    params.isa = (spring_kernel == EMSDSpringKernel::StencilSIMD) ? best_simd_isa() : SimdIsa_Scalar;
+    params.verify_stencil = CVarMSDVerifyStencil.GetValueOnGameThread() != 0;
+    params.multithreaded = bMultithreadedSolver;
+    params.sleep = bAllowSleep;
+    params.sleep_threshold = sleep_threshold;
+    params.collision.thickness = (bWorldCollision || bSelfCollision) ? collision_thickness * grid_size : 0.0f;
+    params.collision.friction = collision_friction;
+    params.collision.self_collision = bSelfCollision;
+    params.plastic.yield_strain = yield_strain;
+    params.plastic.creep_rate = creep_rate;
+    params.plastic.break_strain = break_strain;
     
-    for (int idx = 0; idx < mesh_section.points.Num(); ++idx)
+    if (recorder.frames.Num() != record_steps)
     {
-        Mass_Point *point = &mesh_section.points[idx];
+        recorder.reset(record_steps);
+    }
+    recorder.params.position_step = snapshot_precision;
+    params.recorder = record_steps > 0 ? &recorder : nullptr;
+    return params;
+}
+
+Integrator & AMSDActor::get_integrator()
+{
+    // only called while no step is in flight
+    Integrator_Type type = (Integrator_Type)integrator;
+    if (!solver_integrator || solver_integrator->type() != type)
+    {
+        solver_integrator = make_integrator(type);
+    }
+    return *solver_integrator;
+}
+
+int32 AMSDActor::consume_substeps()
+{
+    int32 allowed = max_substeps;
+    bool throttled = false;
+    if (scheduled)
+    {
+        throttled = schedule.steps < max_substeps;
+        allowed = FMath::Min(allowed, schedule.steps);
+        scheduled = false;
+    }
+    
+    int32 substeps = FMath::FloorToInt(sim_accumulator / fixed_dt);
+    if (substeps > allowed)
+    {
+        // time beyond that is dropped, a throttled body keeps one step of it so
+        // its next turn is never empty
+        substeps = allowed;
+        sim_accumulator = (substeps + (throttled ? 1 : 0)) * fixed_dt;
+    }
+    
+    sim_accumulator = FMath::Max(sim_accumulator - substeps * fixed_dt, 0.0f);
+    return substeps;
+}
+
+void AMSDActor::tick_async()
+{
+    if (simulation_task.IsValid())
+    {
+        if (!simulation_task->IsComplete())
         {
-            FVector force = FVector(0, 0, 0); //g;
-            
-            for (int32 i = 0; i < point->neighbours.Num(); ++i)
-            {
-                int32 ni = point->neighbours[i];
-                if (mesh_section.points.Num() > ni)
-                {
-                    Mass_Point *mp = &mesh_section.points[ni];
-                    
-                    FVector offset = (point->index - mp->index) * grid_size;
-                    FVector anchor = mp->pos + offset;
-                    FVector dist = point->pos - anchor;
-                    FVector dist2 = anchor - point->pos;
-                    
-                    FVector spring_force = -k * dist;
-                    FVector damping_force = damping * point->vel;
+            // previous steps still running, the time stays in the accumulator
+            return;
+        }
         
-                    force += spring_force - damping_force;
-                }
+        simulation_task = nullptr;
+        report_seconds += task_seconds;
+        report_point_steps += task_point_steps;
+        awake_points = solver_awake_points(points);
+        Swap(published_pos, result_pos);
+        update_section(published_pos);
+        update_spatial_index();
+        update_collision_proxy(published_pos);
+        publish_torn();
+    }
+    
+    // the finished task's input becomes the next pending one, so both keep their buffers
+    Swap(task_input, pending_input);
+    pending_input.reset();
+    
+    Integrator * task_integrator = &get_integrator();
+    Solver_Params params = make_solver_params();
+    int32 substeps = consume_substeps();
+    float alpha = sim_accumulator / fixed_dt;
+    task_point_steps = (int64)awake_points * substeps;
+    
+    simulation_task = FFunctionGraphTask::CreateAndDispatchWhenReady([this, task_integrator, params, substeps, alpha]()
+    {
+        const double start = FPlatformTime::Seconds();
+        solver_advance(points, lattice->stencil, *task_integrator, params, task_input, substeps);
+        task_seconds = FPlatformTime::Seconds() - start;
+        // result_pos alternates with published_pos, so it is always filled completely
+        solver_interpolate(points, alpha, result_pos, false);
+    }, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+}
+
+void AMSDActor::wait_for_simulation()
+{
+    if (simulation_task.IsValid())
+    {
+        FTaskGraphInterface::Get().WaitUntilTaskCompletes(simulation_task);
+        simulation_task = nullptr;
+        published_pos = points.pos;
+        spatial_index.reset();
+    }
+}
+
+const TArray<FVector> & AMSDActor::query_positions() const
+{
+    return bAsyncSimulation ? published_pos : points.pos;
+}
+
+void AMSDActor::update_section(const TArray<FVector> & positions)
+{
+    Sleep_State & sleep = points.sleep;
+    const bool tracked = sleep.num_points == positions.Num();
+    const int32 chunk_points = tracked ? sleep.chunk_points : positions.Num();
+    const int32 num_chunks = FMath::DivideAndRoundUp(positions.Num(), FMath::Max(chunk_points, 1));
+    render_chunk_points = chunk_points;
+    
+    render_chunks.SetNumUninitialized(num_chunks);
+    bool any_changed = false;
+    for (int32 chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        render_chunks[chunk] = !tracked || solver_chunk_changed(points, chunk);
+        any_changed |= render_chunks[chunk] != 0;
+        if (tracked)
+        {
+            sleep.chunk_render_dirty[chunk] = false;
+        }
+    }
+    
+    if (!any_changed)
+    {
+        // the whole lattice rests, nothing to write or upload
+        return;
+    }
+    
+    auto Section = mesh_data->BeginSectionUpdate(0);
+    
+    const FVector * pos = positions.GetData();
+    const int32 * vertex_offsets = points.topology->vertex_offsets.GetData();
+    const int32 * vertex_list = points.topology->vertex_list.GetData();
+    
+    {
+        MSD_SCOPE_CYCLE(STAT_MSD_WriteVertices);
+        for (int32 chunk = 0; chunk < num_chunks; ++chunk)
+        {
+            if (!render_chunks[chunk])
+            {
+                continue;
             }
             
-            point->pos = point->pos + (point->vel * DeltaTime);
-            point->vel = point->vel + ((force / mass) * DeltaTime);
-                
+            const int32 begin = chunk * chunk_points;
+            const int32 end = FMath::Min(begin + chunk_points, positions.Num());
+            for (int32 idx = begin; idx < end; ++idx)
+            {
 #if DEBUG_DRAW_FORCE_NET
-            FVector new_pos = GetTransform().Rotator().RotateVector(point->pos);
-            DrawDebugSphere(GetWorld(), GetActorLocation() + new_pos, 0.4, 6, FColor(100, 100, 255, 100), false, DeltaTime);
-            DrawDebugString(GetWorld(), GetActorLocation() + new_pos + FVector(0.0f, -1.0f, -0.0f),
-                            *FString::Printf(TEXT("%d"), idx), NULL, FColor(255, 0, 0, 255), DeltaTime, true);
-            #endif
-            
-            for (int32 i = 0; i < point->indices.Num(); ++i)
+                FVector new_pos = GetTransform().Rotator().RotateVector(pos[idx]);
+                DrawDebugSphere(GetWorld(), GetActorLocation() + new_pos, 0.4, 6, FColor(100, 100, 255, 100), false, 0.0f);
+                DrawDebugString(GetWorld(), GetActorLocation() + new_pos + FVector(0.0f, -1.0f, -0.0f),
+                                *FString::Printf(TEXT("%d"), idx), NULL, FColor(255, 0, 0, 255), 0.0f, true);
+#endif
+
+                for (int32 i = vertex_offsets[idx]; i < vertex_offsets[idx + 1]; ++i)
                 {
-                    int32 ii = point->indices[i];
-                    //FVector pos = Section->GetPosition(ii);
-                    //pos.Z -= DeltaTime;
-                    Section->SetPosition(ii, point->pos);
+                    Section->SetPosition(vertex_list[i], pos[idx]);
                 }
-            #if 0
-        } else {
-#if DEBUG_DRAW_FORCE_NET
-            FVector new_pos = GetTransform().Rotator().RotateVector(point->pos);
-            DrawDebugSphere(GetWorld(), GetActorLocation() + new_pos, 0.4, 6, FColor(255, 100, 100, 100), false, DeltaTime);
-#endif
-            
-#endif
+            }
         }
     }
     
-    Section->Commit();
+    bool normals_changed = false;
+    // far bodies keep their normals, the difference does not show at that size
+    if (bRecomputeNormals && schedule.lod < BodyLod_Far)
+    {
+        const Mesh_Section & mesh = lattice->mesh;
+        normals_changed = surface_recompute_normals(mesh.surface, surface_normals, mesh.triangles, positions, render_chunks, chunk_points, bMultithreadedSolver) > 0;
+        
+        MSD_SCOPE_CYCLE(STAT_MSD_WriteVertices);
+        for (int32 v = 0; normals_changed && v < mesh.surface.Num(); ++v)
+        {
+            if (surface_normals.dirty[v])
+            {
+                Section->SetNormalTangent(v, surface_normals.normal[v], FRuntimeMeshTangent(surface_normals.tangent[v]));
+            }
+        }
+    }
+    
+    // colors, UVs and indices never change after generation, normals and
+    // tangents only when they are recomputed
+    MSD_SCOPE_CYCLE(STAT_MSD_Commit);
+    Section->Commit(true, normals_changed, false, false, false);
 }
 
 void AMSDActor::update_grab(FVector location)
 {
-    FRotator revRot = GetTransform().Rotator().GetInverse();
-    FVector relative_pos = revRot.RotateVector(location - GetActorLocation());
-    
-    for (int32 idx : grabbed_points)
+    if (follows_server())
     {
-        Mass_Point * point = &mesh_section.points[idx];
-        FVector dist = point->pos - relative_pos;
-        //if (dist.Size() > 1)
-        {
-            //FVector grab_force = -10 * dist;
-            point->vel = point->vel - dist;
-        }
+        return;
+    }
+    update_grab_local(location);
+    if (sends_deformation())
+    {
+        multicast_update_grab(location);
     }
 }
 
 void AMSDActor::grab_location(FVector location)
 {
-    grabbed_points = get_mass_points(location, (grid_size / 2) + 0.01);
+    if (follows_server())
+    {
+        return;
+    }
+    grab_location_local(location);
+    if (sends_deformation())
+    {
+        multicast_grab(location);
+    }
 }
 
 void AMSDActor::release_grab()
 {
+    if (follows_server())
+    {
+        return;
+    }
     grabbed_points.Reset();
+    if (sends_deformation())
+    {
+        multicast_release_grab();
+    }
+}
+
+void AMSDActor::update_grab_local(FVector location)
+{
+    FRotator revRot = GetTransform().Rotator().GetInverse();
+    FVector relative_pos = revRot.RotateVector(location - GetActorLocation());
+    
+    mark_active();
+    pending_input.grab_points = grabbed_points;
+    pending_input.grab_target = relative_pos;
+    pending_input.has_grab_target = true;
+}
+
+void AMSDActor::grab_location_local(FVector location)
+{
+    grabbed_points = get_mass_points(location, (grid_size / 2) + 0.01);
+    mark_active();
 }
 
 TArray<int32> AMSDActor::get_mass_points(FVector pos, int32 dist)
@@ -229,17 +715,295 @@ TArray<int32> AMSDActor::get_mass_points(FVector pos, int32 dist)
     FRotator revRot = GetTransform().Rotator().GetInverse();
     FVector relative_pos = revRot.RotateVector(pos - GetActorLocation());
     
-    for (int idx = 0; idx < mesh_section.points.Num(); ++idx)
+    const TArray<FVector> & points_pos = ensure_spatial_index();
+    spatial_query_radius(spatial_index, points_pos, relative_pos, dist, result);
+    return result;
+}
+
+const TArray<FVector> & AMSDActor::ensure_spatial_index()
+{
+    const TArray<FVector> & points_pos = query_positions();
+    if (spatial_source != &points_pos || !spatial_index.is_valid_for(points_pos.Num(), grid_size))
+    {
+        spatial_build(spatial_index, points_pos, grid_size);
+        spatial_source = &points_pos;
+    }
+    return points_pos;
+}
+
+void AMSDActor::update_spatial_index()
+{
+    const TArray<FVector> & points_pos = query_positions();
+    if (spatial_source != &points_pos || !spatial_index.is_valid_for(points_pos.Num(), grid_size))
+    {
+        // built on demand by the next query
+        return;
+    }
+    
+    // the chunks update_section wrote include every chunk that moved
+    spatial_refit(spatial_index, points_pos, render_chunks, render_chunk_points);
+}
+
+void AMSDActor::save_state(TArray<uint8> & data, bool bWithVelocities)
+{
+    wait_for_simulation();
+    Snapshot_Params params;
+    params.position_step = snapshot_precision;
+    params.velocity_step = bWithVelocities ? snapshot_precision : 0.0f;
+    snapshot_save(points, params, data);
+}
+
+bool AMSDActor::restore_state(const TArray<uint8> & data)
+{
+    wait_for_simulation();
+    if (!published_pos.Num() || !snapshot_load(points, data))
+    {
+        return false;
+    }
+    
+    replaying = false;
+    sim_accumulator = 0;
+    pending_input.reset();
+    if (solver_integrator)
+    {
+        solver_integrator->reset();
+    }
+    
+    published_pos = points.pos;
+    awake_points = published_pos.Num();
+    spatial_index.reset();
+    mark_render_dirty();
+    update_section(published_pos);
+    update_collision_proxy(published_pos);
+    // the keyframes send every point and the restored tears again under the
+    // next sequence, so clients take them. Clients keep the springs torn
+    // before, keyframes never heal them
+    keyframe_state.reset();
+    publish_torn();
+    return true;
+}
+
+void AMSDActor::start_replay()
+{
+    wait_for_simulation();
+    if (!recorder.Num())
+    {
+        return;
+    }
+    replaying = true;
+    replay_time = 0;
+    replay_frame = INDEX_NONE;
+}
+
+void AMSDActor::stop_replay()
+{
+    if (!replaying)
+    {
+        return;
+    }
+    
+    // back to the state the simulation stopped at
+    replaying = false;
+    sim_accumulator = 0;
+    published_pos = points.pos;
+    mark_render_dirty();
+    update_section(published_pos);
+    update_collision_proxy(published_pos);
+    patch_torn_surface(published_torn);
+}
+
+void AMSDActor::tick_replay(float DeltaTime)
+{
+    sim_accumulator = 0;
+    const int32 frame = FMath::FloorToInt(replay_time / fixed_dt);
+    replay_time += DeltaTime;
+    if (frame >= recorder.Num())
+    {
+        stop_replay();
+        return;
+    }
+    if (frame == replay_frame)
+    {
+        return;
+    }
+    
+    // the positions and tears of the recorded step alone, the store is left as it is
+    replay_frame = frame;
+    const TArray<uint8> & data = recorder.frame(frame);
+    if (snapshot_read_positions(data, points.topology->rest, render_pos) && snapshot_read_torn(data, *points.topology, replay_torn))
+    {
+        mark_render_dirty();
+        update_section(render_pos);
+        update_collision_proxy(render_pos);
+        patch_torn_surface(replay_torn);
+    }
+}
+
+void AMSDActor::mark_render_dirty()
+{
+    for (uint8 & dirty : points.sleep.chunk_render_dirty)
     {
-        Mass_Point point = mesh_section.points[idx];
-        FVector diff = relative_pos - point.pos;
-        if (diff.Size() < dist)
+        dirty = true;
+    }
+}
+
+void AMSDActor::publish_torn()
+{
+    published_torn = points.torn_springs;
+    patch_torn_surface(published_torn);
+}
+
+void AMSDActor::patch_torn_surface(const TArray<int32> & torn)
+{
+    // tears only add up while a body simulates, restored and replayed states
+    // may lack some of the shown ones
+    const bool adds_up = shown_torn.Num() <= torn.Num() &&
+        FMemory::Memcmp(shown_torn.GetData(), torn.GetData(), shown_torn.Num() * sizeof(int32)) == 0;
+    if (adds_up && shown_torn.Num() == torn.Num())
+    {
+        return;
+    }
+    
+    const Mesh_Section & mesh = lattice->mesh;
+    auto Section = mesh_data->BeginSectionUpdate(0);
+    if (!adds_up)
+    {
+        for (int32 first : hidden_triangles)
         {
-            result.Add(idx);
+            for (int32 corner = 0; corner < 3; ++corner)
+            {
+                Section->SetIndex(first + corner, mesh.triangles[first + corner]);
+            }
         }
+        hidden_triangles.Reset();
+        shown_torn.Reset();
     }
     
-    return result;
+    // only the faces around the springs not shown yet
+    const int32 first_new = hidden_triangles.Num();
+    for (int32 i = shown_torn.Num(); i < torn.Num(); ++i)
+    {
+        surface_spring_triangles(mesh.surface, mesh.lattice, mesh.triangles, torn[i], hidden_triangles);
+    }
+    shown_torn = torn;
+    
+    // collapsed onto their first corner, the split faces draw nothing
+    for (int32 i = first_new; i < hidden_triangles.Num(); ++i)
+    {
+        const int32 first = hidden_triangles[i];
+        Section->SetIndex(first + 1, mesh.triangles[first]);
+        Section->SetIndex(first + 2, mesh.triangles[first]);
+    }
+    Section->Commit(false, false, false, false, true);
+}
+
+void AMSDActor::update_collision_proxy(const TArray<FVector> & positions)
+{
+    if (!collision_proxy.num_hulls() || !proxy_needs_refit(collision_proxy, positions, collision_proxy_tolerance * grid_size))
+    {
+        return;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_ProxyRefit);
+    MSD_ADD_COUNTER(STAT_MSD_ProxyCooks, 1);
+    // same hulls over the same points, only their vertices move
+    proxy_refit(collision_proxy, positions, proxy_hulls);
+    RuntimeMesh->SetCollisionConvexMeshes(proxy_hulls);
+}
+
+void AMSDActor::gather_collision_world()
+{
+    Collision_World & world = pending_input.world;
+    world.reset();
+    if (!bWorldCollision || collision_thickness <= 0.0f)
+    {
+        return;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_GatherShapes);
+    
+    // one query per frame, everything the points can reach before the next one
+    const FBoxSphereBounds & bounds = RuntimeMesh->Bounds;
+    const FVector extent = bounds.BoxExtent + FVector(grid_size * (1.0f + collision_thickness));
+    FCollisionQueryParams query(SCENE_QUERY_STAT(MSDCollision), false, this);
+    FCollisionObjectQueryParams objects(FCollisionObjectQueryParams::AllStaticObjects);
+    objects.AddObjectTypesToQuery(ECC_WorldDynamic);
+    objects.AddObjectTypesToQuery(ECC_PhysicsBody);
+    collision_overlaps.Reset();
+    GetWorld()->OverlapMultiByObjectType(collision_overlaps, bounds.Origin, FQuat::Identity, objects, FCollisionShape::MakeBox(extent), query);
+    
+    // world to lattice space, scale is ignored like everywhere else
+    const FQuat inv_rot = GetActorQuat().Inverse();
+    const FVector origin = GetActorLocation();
+    auto to_local = [&](const FVector & p) { return inv_rot.RotateVector(p - origin); };
+    
+    for (const FOverlapResult & overlap : collision_overlaps)
+    {
+        UPrimitiveComponent * component = overlap.GetComponent();
+        if (!component || Cast<AMSDActor>(component->GetOwner()))
+        {
+            continue;
+        }
+        
+        const FTransform & transform = component->GetComponentTransform();
+        const float scale = transform.GetScale3D().GetAbsMax();
+        UBodySetup * setup = component->GetBodySetup();
+        bool has_shapes = false;
+        if (setup)
+        {
+            const FKAggregateGeom & geom = setup->AggGeom;
+            for (const FKSphereElem & elem : geom.SphereElems)
+            {
+                Collision_Sphere & sphere = world.spheres[world.spheres.AddUninitialized()];
+                sphere.center = to_local(transform.TransformPosition(elem.Center));
+                sphere.radius = elem.Radius * scale;
+            }
+            for (const FKBoxElem & elem : geom.BoxElems)
+            {
+                const FTransform elem_transform = elem.GetTransform() * transform;
+                Collision_Box & box = world.boxes[world.boxes.AddUninitialized()];
+                box.center = to_local(elem_transform.GetLocation());
+                box.axes[0] = inv_rot.RotateVector(elem_transform.GetUnitAxis(EAxis::X));
+                box.axes[1] = inv_rot.RotateVector(elem_transform.GetUnitAxis(EAxis::Y));
+                box.axes[2] = inv_rot.RotateVector(elem_transform.GetUnitAxis(EAxis::Z));
+                box.extent = FVector(elem.X, elem.Y, elem.Z) * 0.5f * elem_transform.GetScale3D().GetAbs();
+            }
+            for (const FKSphylElem & elem : geom.SphylElems)
+            {
+                const FTransform elem_transform = elem.GetTransform() * transform;
+                const FVector half = elem_transform.GetUnitAxis(EAxis::Z) * (elem.Length * 0.5f * scale);
+                Collision_Capsule & capsule = world.capsules[world.capsules.AddUninitialized()];
+                capsule.a = to_local(elem_transform.GetLocation() - half);
+                capsule.b = to_local(elem_transform.GetLocation() + half);
+                capsule.radius = elem.Radius * scale;
+            }
+            for (const FKConvexElem & elem : geom.ConvexElems)
+            {
+                // hulls count as their bounding box
+                Collision_Box & box = world.boxes[world.boxes.AddUninitialized()];
+                box.center = to_local(transform.TransformPosition(elem.ElemBox.GetCenter()));
+                box.axes[0] = inv_rot.RotateVector(transform.GetUnitAxis(EAxis::X));
+                box.axes[1] = inv_rot.RotateVector(transform.GetUnitAxis(EAxis::Y));
+                box.axes[2] = inv_rot.RotateVector(transform.GetUnitAxis(EAxis::Z));
+                box.extent = elem.ElemBox.GetExtent() * transform.GetScale3D().GetAbs();
+            }
+            has_shapes = geom.GetElementCount() > 0;
+        }
+        
+        if (!has_shapes)
+        {
+            // landscapes and complex only meshes, the ground below the body as a plane
+            FHitResult hit;
+            const FVector start = bounds.Origin + FVector(0, 0, extent.Z);
+            const FVector end = bounds.Origin - FVector(0, 0, extent.Z * 2.0f);
+            if (component->LineTraceComponent(hit, start, end, query))
+            {
+                Collision_Plane & plane = world.planes[world.planes.AddUninitialized()];
+                plane.normal = inv_rot.RotateVector(hit.ImpactNormal);
+                plane.distance = FVector::DotProduct(plane.normal, to_local(hit.ImpactPoint));
+            }
+        }
+    }
 }
 
 
@@ -249,33 +1013,172 @@ TArray<int32> AMSDActor::get_mass_points(FVector pos, int32 dist)
 
 void AMSDActor::applyForce(AActor * other, FVector force, FHitResult hit)
 {
-    FTransform trans = GetTransform();
-    FRotator rot = trans.Rotator();
-    FRotator revRot = rot.GetInverse();
-    
-    FVector newForce = revRot.RotateVector(-force);
-    
-    
 #if DEBUG_DRAW_IMPACAT_POINT
     DrawDebugSphere(GetWorld(), hit.ImpactPoint, 1, 6, FColor(255, 255, 0, 100), false, debugTime);
     DrawDebugLine(GetWorld(), hit.Location, hit.Location - (0.02f * force), FColor(255, 0, 0), false, debugTime, 0, 0);
     UE_LOG(LogTemp, Log, TEXT("hit at  %s,  force: %s"), *hit.Location.ToCompactString(), *force.ToCompactString()));
 #endif
-    
-    
+
+
 #if DEBUG_DRAW_IMPACAT_POINT_ROTATED
+    FTransform trans = GetTransform();
+    FRotator rot = trans.Rotator();
+    FRotator revRot = rot.GetInverse();
+    
+    FVector newForce = revRot.RotateVector(-force);
     FVector newHit = revRot.RotateVector(hit.ImpactPoint - GetActorLocation());
     DrawDebugSphere(GetWorld(), newHit, 0.5, 6, FColor(255, 0, 255, 100), false, debugTime);
     DrawDebugLine(GetWorld(), newHit, newHit + (.002f * newForce), FColor(200, 0, 255), false, debugTime, 0, 0);
     UE_LOG(LogTemp, Log, TEXT("rotate at %s, force %s"), *newHit.ToCompactString(), *newForce.ToCompactString()));
 #endif
 
-    TArray<int32> hits = get_mass_points(hit.ImpactPoint, (grid_size * 2) + 0.01);
-    if (hits.Num())
+    FMSDImpulse impulse;
+    impulse.Location = hit.ImpactPoint;
+    impulse.Force = -force;
+    // the whole units the radius of the point query was truncated to
+    impulse.Radius = (int32)((grid_size * 2) + 0.01);
+    
+    TArray<FMSDImpulse> impulses;
+    impulses.Add(impulse);
+    apply_impulses(impulses);
+}
+
+void AMSDActor::apply_impulses(const TArray<FMSDImpulse> & impulses)
+{
+    if (follows_server())
+    {
+        return;
+    }
+    apply_impulses_local(impulses);
+    if (sends_deformation())
     {
-        for (int32 hit_index : hits)
+        multicast_impulses(impulses);
+    }
+}
+
+void AMSDActor::apply_impulses_local(const TArray<FMSDImpulse> & impulses)
+{
+    const TArray<FVector> & points_pos = ensure_spatial_index();
+    const int32 num_points = points_pos.Num();
+    if (!num_points)
+    {
+        return;
+    }
+    
+    mark_active();
+    
+    // world to lattice space, once for the whole batch
+    const FQuat inv_rot = GetActorQuat().Inverse();
+    const FVector origin = GetActorLocation();
+    
+    for (const FMSDImpulse & impulse : impulses)
+    {
+        const FVector center = inv_rot.RotateVector(impulse.Location - origin);
+        const FVector delta_vel = inv_rot.RotateVector(impulse.Force);
+        
+        impulse_hits.Reset();
+        spatial_query_radius(spatial_index, points_pos, center, impulse.Radius, impulse_hits);
+        for (int32 idx : impulse_hits)
         {
-            mesh_section.points[hit_index].vel += newForce;
+            pending_input.add_impulse(idx, delta_vel, num_points);
         }
     }
 }
+
+bool AMSDActor::sends_deformation() const
+{
+    return bReplicateDeformation && GetIsReplicated() && HasAuthority() && GetNetMode() != NM_Standalone;
+}
+
+bool AMSDActor::follows_server() const
+{
+    return bReplicateDeformation && GetIsReplicated() && !HasAuthority();
+}
+
+void AMSDActor::send_keyframe(float DeltaTime)
+{
+    if (!sends_deformation())
+    {
+        return;
+    }
+    
+    keyframe_timer += DeltaTime;
+    if (keyframe_timer < keyframe_interval)
+    {
+        return;
+    }
+    
+    MSD_SCOPE_CYCLE(STAT_MSD_Keyframe);
+    Keyframe_Params params;
+    // rounding uses a quarter of the error a point may have
+    params.position_step = replication_error * 0.25f;
+    params.error_bound = replication_error;
+    params.byte_budget = FMath::FloorToInt(replication_bytes_per_second * keyframe_timer);
+    keyframe_timer = 0;
+    
+    if (keyframe_write(keyframe_state, query_positions(), points.topology->rest, published_torn, params, keyframe_data))
+    {
+        MSD_ADD_COUNTER(STAT_MSD_KeyframeBytes, keyframe_data.Num());
+        multicast_keyframe(keyframe_data);
+    }
+}
+
+void AMSDActor::multicast_impulses_Implementation(const TArray<FMSDImpulse> & impulses)
+{
+    if (follows_server())
+    {
+        apply_impulses_local(impulses);
+    }
+}
+
+void AMSDActor::multicast_grab_Implementation(FVector location)
+{
+    if (follows_server())
+    {
+        grab_location_local(location);
+    }
+}
+
+void AMSDActor::multicast_update_grab_Implementation(FVector location)
+{
+    if (follows_server())
+    {
+        update_grab_local(location);
+    }
+}
+
+void AMSDActor::multicast_release_grab_Implementation()
+{
+    if (follows_server())
+    {
+        grabbed_points.Reset();
+    }
+}
+
+void AMSDActor::multicast_keyframe_Implementation(const TArray<uint8> & data)
+{
+    if (!follows_server() || !published_pos.Num())
+    {
+        return;
+    }
+    
+    uint32 sequence;
+    if (!keyframe_read(data, points.topology->rest, points.topology->num_springs(), sequence, keyframe_points, keyframe_pos, keyframe_torn))
+    {
+        return;
+    }
+    // unreliable keyframes may arrive out of order
+    if (has_keyframe && (int32)(sequence - keyframe_sequence) <= 0)
+    {
+        return;
+    }
+    has_keyframe = true;
+    keyframe_sequence = sequence;
+    
+    // a sleeping body takes them when it steps again
+    for (int32 i = 0; i < keyframe_points.Num(); ++i)
+    {
+        pending_input.add_correction(keyframe_points[i], keyframe_pos[i], published_pos.Num());
+    }
+    pending_input.tear_springs.Append(keyframe_torn);
+}
@@ -4,22 +4,131 @@
 #include "GameFramework/Actor.h"
 #include "RuntimeMeshComponent.h"
 #include "RuntimeMeshActor.h"
-#include "Generator.h"
+#include "Core/Generator.h"
+#include "Core/SpringKernel.h"
+#include "Core/Solver.h"
+#include "Core/Surface.h"
+#include "Core/SpatialIndex.h"
+#include "Core/CollisionProxy.h"
+#include "Core/LatticeTemplate.h"
+#include "Core/Scheduler.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "WorldCollision.h"
 #include "MSDActor.generated.h"
 
+class UMSDLatticeAsset;
+class AMSDManager;
+
+UENUM(BlueprintType)
+enum class EMSDSpringKernel : uint8
+{
+    // per point neighbour lists, works for any topology
+    Neighbours      UMETA(DisplayName = "Neighbour Lists"),
+    // fixed lattice stencil, one float lane at a time; lattices it does not
+    // cover use the spring table
+    StencilScalar   UMETA(DisplayName = "Lattice Stencil (Scalar)"),
+    // fixed lattice stencil, widest SIMD set of the running CPU
+    StencilSIMD     UMETA(DisplayName = "Lattice Stencil (SIMD)"),
+    // every spring once, applied to both ends, works for any topology
+    SpringTable     UMETA(DisplayName = "Spring Table")
+};
+
+// same order as Integrator_Type
+UENUM(BlueprintType)
+enum class EMSDIntegrator : uint8
+{
+    ExplicitEuler    UMETA(DisplayName = "Explicit Euler"),
+    SymplecticEuler  UMETA(DisplayName = "Symplectic Euler"),
+    PositionVerlet   UMETA(DisplayName = "Position Verlet"),
+    // stable with stiff springs and large steps, costs a linear solve per step
+    ImplicitEuler    UMETA(DisplayName = "Implicit Euler")
+};
+
+// same order as Surface_Mode
+UENUM(BlueprintType)
+enum class EMSDSurfaceMode : uint8
+{
+    Quads        UMETA(DisplayName = "Vertices Per Quad"),
+    SharedFaces  UMETA(DisplayName = "Shared Per Face"),
+    Smooth       UMETA(DisplayName = "Shared Smooth")
+};
+
+// same bits as Cube_Side
+UENUM(BlueprintType, Meta = (Bitflags, UseEnumValuesAsMaskValuesInEditor = "true"))
+enum class EMSDCubeSide : uint8
+{
+    Front   = 1,
+    Back    = 2,
+    Left    = 4,
+    Right   = 8,
+    Top     = 16,
+    Bottom  = 32
+};
+
+// Material painted onto part of the body: the points on any of Sides, plus the
+// points inside Box (local space of the undeformed cube) when bUseBox is set.
+// Later entries override the scales of earlier ones where they overlap.
+USTRUCT(BlueprintType)
+struct FMSDMaterial
+{
+    GENERATED_BODY()
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD", Meta = (Bitmask, BitmaskEnum = "EMSDCubeSide"))
+    int32 Sides = 0;
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD")
+    bool bUseBox = false;
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD", Meta = (EditCondition = "bUseBox"))
+    FBox Box = FBox(FVector::ZeroVector, FVector::ZeroVector);
+    
+    // multiplies mass, k and damping of the actor, springs take the mean of their two ends
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD", Meta = (ClampMin = "0.001"))
+    float MassScale = 1.0f;
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float StiffnessScale = 1.0f;
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float DampingScale = 1.0f;
+    
+    // the points are anchors that never move
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD")
+    bool bPinned = false;
+};
+
+// One hit of a batch passed to apply_impulses, in world space. Every mass point
+// within Radius of Location has its velocity changed by Force.
+USTRUCT(BlueprintType)
+struct FMSDImpulse
+{
+    GENERATED_BODY()
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD")
+    FVector Location = FVector::ZeroVector;
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD")
+    FVector Force = FVector::ZeroVector;
+    
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "MSD")
+    float Radius = 0.0f;
+};
+
 UCLASS(HideCategories = (Input), ShowCategories = ("Input|MouseInput", "Input|TouchInput"), ComponentWrapperClass, Meta = (ChildCanTick))
 class MSD_EXAMPLE_API AMSDActor : public AActor
 {
     GENERATED_UCLASS_BODY()
-    
+
 public:
-   
+
     virtual void OnConstruction(const FTransform& Transform) override;
     
     virtual void Tick(float DeltaTime) override;
     
     virtual void BeginPlay() override;
     
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    
     void OnClick(UPrimitiveComponent* pComponent);
     
     
@@ -27,6 +136,11 @@ public:
     UFUNCTION(BlueprintCallable, Category = "MSD")
     void applyForce(AActor * other, FVector force, FHitResult hit);
     
+    // Resolves many hits in one pass and accumulates them into the input of the
+    // next step, cheaper than one applyForce call per hit.
+    UFUNCTION(BlueprintCallable, Category = "MSD")
+    void apply_impulses(const TArray<FMSDImpulse> & impulses);
+    
     UFUNCTION(BlueprintCallable, Category = "MSD")
     void update_grab(FVector location);
     
@@ -36,10 +150,44 @@ public:
     UFUNCTION(BlueprintCallable, Category = "MSD")
     void release_grab();
     
+    // positions, and velocities when asked for, as compact bytes for save
+    // games and repros. Without velocities the body restarts at rest
+    UFUNCTION(BlueprintCallable, Category = "MSD")
+    void save_state(TArray<uint8> & data, bool bWithVelocities);
+    
+    // false when data is damaged or from a lattice with another point count
+    UFUNCTION(BlueprintCallable, Category = "MSD")
+    bool restore_state(const TArray<uint8> & data);
+    
+    // shows the recorded steps again, one per fixed_dt, without simulating.
+    // The simulation carries on from where it stopped once the replay ends
+    UFUNCTION(BlueprintCallable, Category = "MSD")
+    void start_replay();
+    
+    UFUNCTION(BlueprintCallable, Category = "MSD")
+    void stop_replay();
+    
+    // what the server's bodies send their clients: every hit and grab as it
+    // happens, and keyframes of the positions that drifted apart since
+    UFUNCTION(NetMulticast, Reliable)
+    void multicast_impulses(const TArray<FMSDImpulse> & impulses);
+    
+    UFUNCTION(NetMulticast, Reliable)
+    void multicast_grab(FVector location);
+    
+    UFUNCTION(NetMulticast, Unreliable)
+    void multicast_update_grab(FVector location);
+    
+    UFUNCTION(NetMulticast, Reliable)
+    void multicast_release_grab();
+    
+    UFUNCTION(NetMulticast, Unreliable)
+    void multicast_keyframe(const TArray<uint8> & data);
+    
+    
     
- 
     class URuntimeMeshComponent* GetRuntimeMeshComponent() const { return RuntimeMesh; }
- 
+    
     
     
     
@@ -53,7 +201,7 @@ public:
     
     UPROPERTY(Category = "MSD", EditAnywhere, Meta = (AllowPrivateAccess = "true"))
     bool bRunGenerateMeshesOnConstruction;
-    
+
 	UPROPERTY(Category = "MSD", EditAnywhere, Meta = (AllowPrivateAccess = "true"))
     bool bRunGenerateMeshesOnBeginPlay;
     
@@ -73,6 +221,156 @@ public:
     UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
     float damping;
     
+    // vertex layout of the render surface, applied on the next generation
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    EMSDSurfaceMode surface_mode;
+    
+    // simulate only the points less than this many steps from the surface, 0
+    // simulates the full volume, cost then grows with the volume instead of the
+    // surface. Hollow cubes want some shear and bend stiffness to hold their shape
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0"))
+    int32 shell_layers;
+    
+    // stiffness of the face diagonal springs as a fraction of k, resists shear
+    // without leaning on damping. 0 leaves them out
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float shear_stiffness;
+    
+    // stiffness of the springs two steps along an axis as a fraction of k,
+    // resists bending. 0 leaves them out
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float bend_stiffness;
+    
+    // painted materials and anchors, applied in order on the next generation.
+    // By default the top face is pinned and the cube hangs from it
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    TArray<FMSDMaterial> materials;
+    
+    // prebuilt lattice, replaces the generation parameters above when set
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    UMSDLatticeAsset* lattice_asset;
+    
+    // recompute normals and tangents around moved points every frame instead of
+    // keeping the ones of the undeformed cube
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bRecomputeNormals;
+    
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    EMSDSpringKernel spring_kernel;
+    
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    EMSDIntegrator integrator;
+    
+    // conjugate gradient budget of the implicit integrator
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "1", EditCondition = "integrator == EMSDIntegrator::ImplicitEuler"))
+    int32 cg_max_iterations;
+    
+    // relative residual the conjugate gradient stops at
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float cg_tolerance;
+    
+    // stop simulating and uploading parts of the lattice that came to rest
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bAllowSleep;
+    
+    // velocity below which a point counts as resting
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0", EditCondition = "bAllowSleep"))
+    float sleep_threshold;
+    
+    // keep points away from the simple collision shapes of the world around
+    // the body, gathered once per frame
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bWorldCollision;
+    
+    // push apart points of this body that are not lattice neighbours, for
+    // cubes that fold onto themselves
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bSelfCollision;
+    
+    // distance points keep from the world as a fraction of grid_size, points
+    // keep twice that from each other
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0", ClampMax = "0.7"))
+    float collision_thickness;
+    
+    // tangential velocity a contact removes per unit of normal velocity it stops
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float collision_friction;
+    
+    // strain a spring takes back fully, beyond it the spring's rest creeps
+    // towards its current shape and dents stay. 0 keeps every spring elastic
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float yield_strain;
+    
+    // share of the strain beyond yield_strain taken as rest per second
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float creep_rate;
+    
+    // strain that tears a spring and opens the faces across it, 0 for none
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float break_strain;
+    
+    // steps the recorder keeps for start_replay, 0 records nothing
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0"))
+    int32 record_steps;
+    
+    // precision of saved and recorded positions in cm and velocities in cm/s
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0001"))
+    float snapshot_precision;
+    
+    // convex hulls over a coarse subset of the points as the body's collision,
+    // so traces and physics bodies hit the deformed shape
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bCollisionProxy;
+    
+    // hulls per axis, applied on the next generation
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "1", ClampMax = "4", EditCondition = "bCollisionProxy"))
+    int32 collision_proxy_blocks;
+    
+    // distance as a fraction of grid_size a hull vertex moves before the hulls
+    // are cooked again, on a background thread
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0", EditCondition = "bCollisionProxy"))
+    float collision_proxy_tolerance;
+    
+    // split the solver step across worker threads, results are identical either way
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bMultithreadedSolver;
+    
+    // length of one solver step in seconds, frames run as many steps as fit
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.001"))
+    float fixed_dt;
+    
+    // steps a single frame may run, time beyond that is dropped instead of
+    // making the next frame even slower
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "1"))
+    int32 max_substeps;
+    
+    // step the simulation on a background task while the frame renders and only
+    // swap in its finished positions, inputs are applied one step later
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bAsyncSimulation;
+    
+    // let the world's AMSDManager lower the rate of this body when it is small
+    // on screen, stop it when unseen or resting, and fit it into the budget
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bManaged;
+    
+    // server authoritative deformation: clients ignore their own hits and
+    // grabs, replay the server's and are corrected by its keyframes. Needs
+    // bReplicates
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bReplicateDeformation;
+    
+    // keyframe bytes per second and body at most
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0", EditCondition = "bReplicateDeformation"))
+    int32 replication_bytes_per_second;
+    
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.01", EditCondition = "bReplicateDeformation"))
+    float keyframe_interval;
+    
+    // distance in cm a client's point may be off before the server sends it
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.01", EditCondition = "bReplicateDeformation"))
+    float replication_error;
+    
     
     
     UPROPERTY(VisibleAnywhere, BluePrintReadWrite, Category = "MSD")
@@ -85,9 +383,137 @@ public:
     TArray<int32> get_mass_points(FVector pos, int32 dist);
     
     float dt;
+    
+    // called by the manager ahead of this body's tick
+    Body_Schedule_Input make_schedule_input(float DeltaTime) const;
+    void set_schedule(const Body_Schedule & new_schedule);
+    // adds the steps run since the last call and the seconds they took
+    void take_step_report(int64 & point_steps, double & seconds);
+    
+    // One frame of Tick in three parts, so the manager can step many bodies
+    // together. prepare_step and finish_step run on the game thread, run_step
+    // may run on a worker alongside the steps of other bodies and splits its
+    // own work across workers only when multithreaded is set. prepare_step
+    // returns false when there is nothing to step this frame.
+    bool prepare_step(float DeltaTime);
+    void run_step(bool multithreaded);
+    void finish_step();
+    
+    int32 num_points() const { return published_pos.Num(); }
 
 private:
-    Mesh_Section mesh_section;
-    int frame_counter;
+    Solver_Params make_solver_params();
+    TArray<Material_Paint> make_material_paints() const;
+    Integrator & get_integrator();
+    int32 consume_substeps();
+    // the last hit or grab, keeps a managed body at the full rate for a while
+    void mark_active();
+    void tick_async();
+    void tick_replay(float DeltaTime);
+    // server sends, clients only take what the server sent
+    bool sends_deformation() const;
+    bool follows_server() const;
+    void send_keyframe(float DeltaTime);
+    void apply_impulses_local(const TArray<FMSDImpulse> & impulses);
+    void grab_location_local(FVector location);
+    void update_grab_local(FVector location);
+    // every chunk is written by the next update_section
+    void mark_render_dirty();
+    void wait_for_simulation();
+    void update_section(const TArray<FVector> & positions);
+    void update_spatial_index();
+    // recooks the collision hulls once positions moved far enough from them
+    void update_collision_proxy(const TArray<FVector> & positions);
+    // hides the faces of the springs of torn, only those not hidden yet, and
+    // shows the hidden ones again when torn does not start with them
+    void patch_torn_surface(const TArray<int32> & torn);
+    // the torn springs of the finished step, for the game thread
+    void publish_torn();
+    // world shapes around the body into pending_input.world, in local space
+    void gather_collision_world();
+    const TArray<FVector> & ensure_spatial_index();
+    
+    // positions grab and hit queries run against, the store is owned by the
+    // background step while one is in flight
+    const TArray<FVector> & query_positions() const;
+    
+    // shared with every body of the same lattice, points only hold this body's state
+    Lattice_Template_Ref lattice;
+    Particle_Store points;
+    Surface_Normals surface_normals;
+    TUniquePtr<Integrator> solver_integrator;
+    // the section data of RuntimeMesh, looked up once per generation
+    FRuntimeMeshDataPtr mesh_data;
+    
+    // what prepare_step decided for run_step
+    Integrator * step_integrator;
+    Solver_Params step_params;
+    int32 step_substeps;
+    float step_alpha;
+    
+    Solver_Input pending_input;
+    Solver_Input task_input;
+    FGraphEventRef simulation_task;
+    TArray<FVector> published_pos;
+    TArray<FVector> result_pos;
+    TArray<FVector> render_pos;
+    // chunks written by the last update_section
+    TArray<uint8> render_chunks;
+    int32 render_chunk_points;
+    
+    // over query_positions(), refit after every update_section
+    Spatial_Grid spatial_index;
+    const TArray<FVector> * spatial_source;
+    // scratch of apply_impulses
+    TArray<int32> impulse_hits;
+    // the last record_steps steps, captured by the solver
+    State_Recorder recorder;
+    bool replaying;
+    float replay_time;
+    // recorded step on screen
+    int32 replay_frame;
+    // scratch of tick_replay
+    TArray<int32> replay_torn;
+    
+    Keyframe_State keyframe_state;
+    float keyframe_timer;
+    // newest keyframe a client applied, older ones arriving late are dropped
+    uint32 keyframe_sequence;
+    bool has_keyframe;
+    // scratch of send_keyframe and multicast_keyframe
+    TArray<uint8> keyframe_data;
+    TArray<int32> keyframe_points;
+    TArray<FVector> keyframe_pos;
+    TArray<int32> keyframe_torn;
+    
+    // points.torn_springs as of the last finished step, like published_pos
+    TArray<int32> published_torn;
+    // first index of every face hidden by a torn spring, until generation
+    TArray<int32> hidden_triangles;
+    // the torn springs hidden_triangles belongs to, in order
+    TArray<int32> shown_torn;
+    
+    Collision_Proxy collision_proxy;
+    // scratch of update_collision_proxy
+    TArray<TArray<FVector>> proxy_hulls;
+    // scratch of gather_collision_world
+    TArray<FOverlapResult> collision_overlaps;
+    float sim_accumulator;
+    // points the last finished step simulated, for the stat counters
+    int32 awake_points;
+    
     TArray<int32> grabbed_points;
+    
+    TWeakObjectPtr<AMSDManager> manager;
+    // the manager's decision for this frame, only applied while scheduled is
+    // set, the body runs at the full rate otherwise
+    Body_Schedule schedule;
+    bool scheduled;
+    int32 starved_frames;
+    float last_active_time;
+    int64 report_point_steps;
+    double report_seconds;
+    // cost of the background step, reported once it finished
+    int64 task_point_steps;
+    double task_seconds;
 };
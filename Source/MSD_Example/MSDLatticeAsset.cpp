@@ -0,0 +1,111 @@
+#include "MSDLatticeAsset.h"
+
+// bump when the stored streams change
+#define MSD_LATTICE_ASSET_VERSION 1
+
+
+UMSDLatticeAsset::UMSDLatticeAsset()
+{
+    dimension = FVector(20, 20, 20);
+    grid_size = 5;
+    surface_mode = EMSDSurfaceMode::SharedFaces;
+    shell_layers = 0;
+    shear_stiffness = 0.0f;
+    bend_stiffness = 0.0f;
+}
+
+void UMSDLatticeAsset::Build()
+{
+    const FVector steps = dimension / grid_size;
+    if (dimension.X <= 0 || dimension.Y <= 0 || dimension.Z <= 0 || grid_size <= 0 ||
+        (steps.X - (int)(steps.X)) != 0.0f || (steps.Y - (int)(steps.Y)) != 0.0f || (steps.Z - (int)(steps.Z)) != 0.0f)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s: dimension must be a positive multiple of the grid size"), *GetName());
+        return;
+    }
+
+    built_key = GetKey();
+    lattice = lattice_cache_acquire(built_key);
+    MarkPackageDirty();
+}
+
+Lattice_Key UMSDLatticeAsset::GetKey() const
+{
+    return make_lattice_key(dimension, grid_size, (Surface_Mode)surface_mode, shell_layers, shear_stiffness, bend_stiffness);
+}
+
+bool UMSDLatticeAsset::IsBuilt() const
+{
+    // editing the parameters without building again leaves a stale lattice
+    return lattice.IsValid() && grid_size > 0 && built_key == GetKey();
+}
+
+Lattice_Template_Ref UMSDLatticeAsset::Acquire() const
+{
+    return lattice;
+}
+
+void UMSDLatticeAsset::Serialize(FArchive& Ar)
+{
+    Super::Serialize(Ar);
+
+    // the version, the flag and the key never change their layout, streams
+    // of any other version are skipped and the key generates them again
+    int32 version = MSD_LATTICE_ASSET_VERSION;
+    bool built = lattice.IsValid();
+    Ar << version << built;
+    if (!built)
+    {
+        lattice.Reset();
+        return;
+    }
+
+    uint8 mode = (uint8)built_key.surface_mode;
+    Ar << built_key.size << built_key.grid_size << mode;
+    Ar << built_key.shell_layers << built_key.shear_stiffness << built_key.bend_stiffness;
+    built_key.surface_mode = (Surface_Mode)mode;
+
+    // patched in after the streams when saving
+    const int64 size_offset = Ar.Tell();
+    int64 streams_size = 0;
+    Ar << streams_size;
+    const int64 streams_begin = Ar.Tell();
+
+    if (Ar.IsLoading() && version != MSD_LATTICE_ASSET_VERSION)
+    {
+        Ar.Seek(streams_begin + streams_size);
+        lattice = lattice_cache_acquire(built_key);
+        return;
+    }
+
+    // loading fills a mesh of its own, anything else only reads the template's
+    Mesh_Section loaded;
+    Mesh_Section & mesh = Ar.IsLoading() ? loaded : const_cast<Mesh_Section &>(lattice->mesh);
+
+    Ar << mesh.size << mesh.vertices << mesh.triangles;
+
+    Lattice_Topology & topology = mesh.lattice;
+    Ar << topology.rest << topology.side;
+    Ar << topology.neighbour_offsets << topology.neighbour_list;
+    Ar << topology.vertex_offsets << topology.vertex_list;
+    Ar << topology.neighbour_spring << topology.point_stiffness;
+    Ar << topology.spring_a << topology.spring_b << topology.spring_rest << topology.spring_stiffness << topology.spring_type;
+    Ar << topology.spring_block_offsets << topology.axis_springs_only;
+
+    Surface_Topology & surface = mesh.surface;
+    Ar << surface.vertex_point << surface.rest_normal << surface.rest_tangent << surface.uv;
+    Ar << surface.triangle_offsets << surface.triangle_list;
+
+    if (Ar.IsSaving() && size_offset != INDEX_NONE)
+    {
+        const int64 streams_end = Ar.Tell();
+        streams_size = streams_end - streams_begin;
+        Ar.Seek(size_offset);
+        Ar << streams_size;
+        Ar.Seek(streams_end);
+    }
+    if (Ar.IsLoading())
+    {
+        lattice = lattice_cache_adopt(built_key, MoveTemp(loaded));
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "MSDActor.h"
+#include "Core/LatticeTemplate.h"
+#include "MSDLatticeAsset.generated.h"
+
+// A lattice generated in the editor and saved with the package, so the bodies
+// using it skip generation when a level loads. Loaded lattices go through the
+// same template cache as generated ones and are shared with every body of the
+// same parameters.
+UCLASS(BlueprintType)
+class MSD_EXAMPLE_API UMSDLatticeAsset : public UDataAsset
+{
+    GENERATED_BODY()
+
+public:
+    UMSDLatticeAsset();
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MSD")
+    FVector dimension;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MSD")
+    float grid_size;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MSD")
+    EMSDSurfaceMode surface_mode;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MSD", Meta = (ClampMin = "0"))
+    int32 shell_layers;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float shear_stiffness;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float bend_stiffness;
+
+    // generates the lattice of the parameters above and stores it in the asset
+    UFUNCTION(CallInEditor, Category = "MSD")
+    void Build();
+
+    // the stored lattice matches the parameters
+    bool IsBuilt() const;
+    Lattice_Key GetKey() const;
+    // the shared template of the stored lattice, only valid while IsBuilt
+    Lattice_Template_Ref Acquire() const;
+
+    virtual void Serialize(FArchive& Ar) override;
+
+private:
+    // parameters the stored lattice was built with
+    Lattice_Key built_key;
+    // the stored lattice lives in the template cache, shared with the bodies
+    Lattice_Template_Ref lattice;
+};
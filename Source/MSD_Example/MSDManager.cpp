@@ -0,0 +1,186 @@
+#include "MSDManager.h"
+
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Core/MSDStats.h"
+#include "MSDActor.h"
+
+// bodies with more points step alone, chunked across workers
+#define MSD_BATCH_LARGE_POINTS (SOLVER_CHUNK_POINTS * 4)
+
+
+AMSDManager::AMSDManager(const FObjectInitializer& ObjectInitializer)
+: Super(ObjectInitializer)
+{
+    PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.TickGroup = TG_PrePhysics;
+    
+    Schedule_Params defaults;
+    budget_ms = 4.0f;
+    reduced_screen_size = defaults.reduced_screen_size;
+    far_screen_size = defaults.far_screen_size;
+    active_seconds = defaults.active_seconds;
+    bSleepOffscreen = defaults.sleep_offscreen;
+    bSleepResting = defaults.sleep_resting;
+    bBatchTick = true;
+}
+
+AMSDManager * AMSDManager::Get(UWorld * world)
+{
+    if (!world || !world->IsGameWorld())
+    {
+        return nullptr;
+    }
+    
+    TActorIterator<AMSDManager> it(world);
+    if (it)
+    {
+        return *it;
+    }
+    
+    FActorSpawnParameters spawn;
+    spawn.ObjectFlags |= RF_Transient;
+    return world->SpawnActor<AMSDManager>(spawn);
+}
+
+void AMSDManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    // bodies that outlive the manager go back to their own tick
+    for (const TWeakObjectPtr<AMSDActor> & body : bodies)
+    {
+        if (body.IsValid())
+        {
+            body->SetActorTickEnabled(true);
+        }
+    }
+    bodies.Reset();
+    Super::EndPlay(EndPlayReason);
+}
+
+void AMSDManager::register_body(AMSDActor * body)
+{
+    bodies.AddUnique(body);
+    body->SetActorTickEnabled(!bBatchTick);
+}
+
+void AMSDManager::unregister_body(AMSDActor * body)
+{
+    bodies.Remove(body);
+}
+
+Schedule_Params AMSDManager::make_schedule_params() const
+{
+    Schedule_Params params;
+    params.budget_ms = budget_ms;
+    params.reduced_screen_size = reduced_screen_size;
+    params.far_screen_size = far_screen_size;
+    params.active_seconds = active_seconds;
+    params.sleep_offscreen = bSleepOffscreen;
+    params.sleep_resting = bSleepResting;
+    return params;
+}
+
+void AMSDManager::Tick(float DeltaTime)
+{
+    Super::Tick(DeltaTime);
+    MSD_SCOPE_CYCLE(STAT_MSD_Schedule);
+    
+    bodies.RemoveAll([](const TWeakObjectPtr<AMSDActor> & body) { return !body.IsValid(); });
+    
+    // what the bodies' steps cost since the last frame
+    int64 point_steps = 0;
+    double seconds = 0.0;
+    for (const TWeakObjectPtr<AMSDActor> & body : bodies)
+    {
+        body->take_step_report(point_steps, seconds);
+    }
+    schedule_report(scheduler, point_steps, seconds);
+    
+    // without a player camera every body counts as close and seen, so does
+    // every body of a dedicated server, whose clients are the ones looking
+    bool has_view = false;
+    FVector view_origin = FVector::ZeroVector;
+    float view_scale = 1.0f;
+    APlayerController * controller = GetWorld()->GetFirstPlayerController();
+    if (controller && controller->PlayerCameraManager && GetNetMode() != NM_DedicatedServer)
+    {
+        has_view = true;
+        view_origin = controller->PlayerCameraManager->GetCameraLocation();
+        view_scale = FMath::Tan(FMath::DegreesToRadians(FMath::Max(controller->PlayerCameraManager->GetFOVAngle(), 1.0f) * 0.5f));
+    }
+    
+    inputs.SetNum(bodies.Num());
+    for (int32 i = 0; i < bodies.Num(); ++i)
+    {
+        AMSDActor * body = bodies[i].Get();
+        Body_Schedule_Input & input = inputs[i];
+        input = body->make_schedule_input(DeltaTime);
+        
+        const FBoxSphereBounds & bounds = body->GetRuntimeMeshComponent()->Bounds;
+        const float distance = FMath::Max(FVector::Dist(view_origin, bounds.Origin), bounds.SphereRadius);
+        input.screen_size = has_view && distance > 0.0f ? bounds.SphereRadius / (distance * view_scale) : 1.0f;
+        input.visible = !has_view || body->WasRecentlyRendered(0.25f);
+    }
+    
+    schedule_bodies(scheduler, make_schedule_params(), inputs, schedules);
+    
+    int32 asleep = 0;
+    int32 starved = 0;
+    for (int32 i = 0; i < bodies.Num(); ++i)
+    {
+        bodies[i]->set_schedule(schedules[i]);
+        asleep += schedules[i].lod == BodyLod_Asleep;
+        starved += schedules[i].starved;
+    }
+    
+    MSD_ADD_COUNTER(STAT_MSD_Bodies, bodies.Num());
+    MSD_ADD_COUNTER(STAT_MSD_SleepingBodies, asleep);
+    MSD_ADD_COUNTER(STAT_MSD_StarvedBodies, starved);
+    
+    if (bBatchTick)
+    {
+        tick_bodies(DeltaTime);
+    }
+}
+
+void AMSDManager::tick_bodies(float DeltaTime)
+{
+    MSD_SCOPE_CYCLE(STAT_MSD_BatchStep);
+    
+    small_bodies.Reset();
+    large_bodies.Reset();
+    for (const TWeakObjectPtr<AMSDActor> & body : bodies)
+    {
+        if (body->IsActorTickEnabled())
+        {
+            // bBatchTick was switched on since the body registered
+            body->SetActorTickEnabled(false);
+        }
+        
+        if (body->prepare_step(DeltaTime * body->CustomTimeDilation))
+        {
+            (body->num_points() > MSD_BATCH_LARGE_POINTS ? large_bodies : small_bodies).Add(body.Get());
+        }
+    }
+    
+    // the steps of different bodies share nothing, small ones run a task each
+    ParallelFor(small_bodies.Num(), [this](int32 i)
+    {
+        small_bodies[i]->run_step(false);
+    });
+    for (AMSDActor * body : large_bodies)
+    {
+        body->run_step(body->bMultithreadedSolver);
+    }
+    
+    for (AMSDActor * body : small_bodies)
+    {
+        body->finish_step();
+    }
+    for (AMSDActor * body : large_bodies)
+    {
+        body->finish_step();
+    }
+}
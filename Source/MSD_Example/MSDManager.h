@@ -0,0 +1,75 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Core/Scheduler.h"
+#include "MSDManager.generated.h"
+
+class AMSDActor;
+
+// Decides once per frame how often every MSD body of its world simulates: by
+// the body's size on screen, whether it is seen at all and whether it was hit
+// or grabbed lately, and within one time budget for all bodies together.
+// Place one in the level to tune it, otherwise the first body spawns one with
+// the defaults. Bodies tick after it, or not at all while the manager steps
+// them as one batch.
+UCLASS()
+class MSD_EXAMPLE_API AMSDManager : public AActor
+{
+    GENERATED_UCLASS_BODY()
+
+public:
+    virtual void Tick(float DeltaTime) override;
+    
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    
+    // the manager of a game world, spawned on first use, null in editor worlds
+    static AMSDManager * Get(UWorld * world);
+    
+    void register_body(AMSDActor * body);
+    void unregister_body(AMSDActor * body);
+    
+    // simulation time of all bodies per frame in milliseconds, 0 for no limit
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float budget_ms;
+    
+    // projected radius over half the view height below which a body runs every
+    // other frame, and below far_screen_size every fourth frame
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float reduced_screen_size;
+    
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float far_screen_size;
+    
+    // seconds a hit or grab keeps a body at the full rate, on screen or not
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD", Meta = (ClampMin = "0.0"))
+    float active_seconds;
+    
+    // stop bodies that were not rendered lately
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bSleepOffscreen;
+    
+    // stop bodies whose points all rest, needs bAllowSleep on the body
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bSleepResting;
+    
+    // step every body from the manager's tick instead of their own: small
+    // bodies one per worker task, large ones split into chunks one after the
+    // other, then all mesh updates in one pass. Bodies skip their own Tick,
+    // and with it the blueprint tick event, while this is set
+    UPROPERTY(EditAnywhere, BluePrintReadWrite, Category = "MSD")
+    bool bBatchTick;
+
+private:
+    Schedule_Params make_schedule_params() const;
+    void tick_bodies(float DeltaTime);
+    
+    TArray<TWeakObjectPtr<AMSDActor>> bodies;
+    TArray<Body_Schedule_Input> inputs;
+    TArray<Body_Schedule> schedules;
+    Body_Scheduler scheduler;
+    
+    // scratch of tick_bodies
+    TArray<AMSDActor *> small_bodies;
+    TArray<AMSDActor *> large_bodies;
+};
@@ -0,0 +1,397 @@
+// Command line benchmark of the MSD core, built without the engine.
+//
+// For every combination of lattice size, integrator and worker thread count it
+// generates a cube of size^3 mass points, runs solver steps for a fixed amount
+// of wall time and reports steps per second, nanoseconds per point and step and
+// the bytes the simulation keeps per point, split into the state every body owns
+// and the lattice template bodies of the same size share. Hollow lattices
+// (--shell) also report how far their surface ends up from the plain full
+// volume's, --shear and --bend add those springs to the simulated lattice.
+
+#include "Generator.h"
+#include "LatticeTemplate.h"
+#include "Solver.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// the actor's defaults
+#define BENCH_GRID_SIZE 5.0f
+#define BENCH_MASS      20.0f
+#define BENCH_K         50.0f
+#define BENCH_DAMPING   10.0f
+#define BENCH_DT        (1.0f / 60.0f)
+
+// steps after the kick at which shells are compared against the full volume
+#define BENCH_QUALITY_STEPS 30
+
+typedef std::chrono::steady_clock Bench_Clock;
+
+enum Bench_Kernel
+{
+    BenchKernel_Neighbours = 0,
+    BenchKernel_Scalar,
+    BenchKernel_SIMD,
+    BenchKernel_Springs
+};
+
+struct Bench_Options
+{
+    TArray<int32> sizes;
+    TArray<int32> integrators;
+    TArray<int32> threads;
+    Bench_Kernel kernel = BenchKernel_SIMD;
+    float seconds = 1.0f;
+    int32 min_steps = 5;
+    int32 shell = 0;
+    float shear = 0.0f;
+    float bend = 0.0f;
+    bool pin_top = false;
+    bool collide = false;
+    bool sleep = false;
+    bool csv = false;
+};
+
+struct Bench_Result
+{
+    int32 points;
+    int32 steps;
+    double seconds;
+    double generate_ms;
+    SIZE_T bytes;
+    SIZE_T shared_bytes;
+    // RMS distance of the surface from the full volume's relative to its RMS displacement, 0 for full volumes
+    double surface_error;
+};
+
+static const char * integrator_names[] = { "explicit", "symplectic", "verlet", "implicit" };
+static const char * kernel_names[] = { "neighbours", "scalar", "simd", "springs" };
+
+
+static double elapsed_seconds(Bench_Clock::time_point begin)
+{
+    return std::chrono::duration<double>(Bench_Clock::now() - begin).count();
+}
+
+static bool parse_list(const char * text, TArray<int32> & result)
+{
+    result.Reset();
+    std::string list(text);
+    size_t begin = 0;
+    while (begin <= list.size())
+    {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos)
+        {
+            end = list.size();
+        }
+
+        const int32 value = atoi(list.substr(begin, end - begin).c_str());
+        if (value <= 0)
+        {
+            return false;
+        }
+        result.Add(value);
+        begin = end + 1;
+    }
+    return result.Num() > 0;
+}
+
+static bool parse_integrators(const char * text, TArray<int32> & result)
+{
+    result.Reset();
+    if (!strcmp(text, "all"))
+    {
+        for (int32 type = 0; type < 4; ++type)
+        {
+            result.Add(type);
+        }
+        return true;
+    }
+
+    std::string list(text);
+    size_t begin = 0;
+    while (begin <= list.size())
+    {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos)
+        {
+            end = list.size();
+        }
+
+        const std::string name = list.substr(begin, end - begin);
+        int32 found = INDEX_NONE;
+        for (int32 type = 0; type < 4; ++type)
+        {
+            if (name == integrator_names[type])
+            {
+                found = type;
+            }
+        }
+        if (found == INDEX_NONE)
+        {
+            return false;
+        }
+        result.Add(found);
+        begin = end + 1;
+    }
+    return true;
+}
+
+static void print_usage()
+{
+    printf("usage: msdbench [options]\n"
+           "  --sizes N,N,...        points per cube edge (default 10,25,50,100)\n"
+           "  --integrators LIST     explicit,symplectic,verlet,implicit or all (default all)\n"
+           "  --threads N,N,...      worker thread counts (default 1 and all hardware threads)\n"
+           "  --kernel NAME          neighbours, scalar, simd or springs (default simd), lattices\n"
+           "                         the stencil does not cover use the spring table unless neighbours\n"
+           "  --seconds S            wall time per configuration (default 1)\n"
+           "  --min-steps N          steps per configuration at least (default 5)\n"
+           "  --shell N              simulate hollow lattices of N layers, 0 for the full volume (default 0)\n"
+           "  --shear S              shear spring stiffness as a fraction of k, 0 for none (default 0)\n"
+           "  --bend S               bend spring stiffness as a fraction of k, 0 for none (default 0)\n"
+           "  --pin-top              pin the top face, its points are left out of the integration\n"
+           "  --collide              rest the cube on a floor and collide its points with each other\n"
+           "  --sleep                let resting chunks sleep, off by default so every step does full work\n"
+           "  --csv                  comma separated output\n");
+}
+
+static bool parse_options(int argc, char ** argv, Bench_Options & options)
+{
+    parse_list("10,25,50,100", options.sizes);
+    parse_integrators("all", options.integrators);
+    options.threads.Add(1);
+    const int32 hardware = (int32)std::thread::hardware_concurrency();
+    if (hardware > 1)
+    {
+        options.threads.Add(hardware);
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char * arg = argv[i];
+        const char * value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+
+        if (!strcmp(arg, "--sizes") && value)              { ok = parse_list(value, options.sizes); ++i; }
+        else if (!strcmp(arg, "--integrators") && value)   { ok = parse_integrators(value, options.integrators); ++i; }
+        else if (!strcmp(arg, "--threads") && value)       { ok = parse_list(value, options.threads); ++i; }
+        else if (!strcmp(arg, "--seconds") && value)       { options.seconds = (float)atof(value); ok = options.seconds > 0; ++i; }
+        else if (!strcmp(arg, "--min-steps") && value)     { options.min_steps = atoi(value); ok = options.min_steps > 0; ++i; }
+        else if (!strcmp(arg, "--shell") && value)         { options.shell = atoi(value); ok = options.shell >= 0; ++i; }
+        else if (!strcmp(arg, "--shear") && value)         { options.shear = (float)atof(value); ok = options.shear >= 0; ++i; }
+        else if (!strcmp(arg, "--bend") && value)          { options.bend = (float)atof(value); ok = options.bend >= 0; ++i; }
+        else if (!strcmp(arg, "--pin-top"))                { options.pin_top = true; }
+        else if (!strcmp(arg, "--collide"))                { options.collide = true; }
+        else if (!strcmp(arg, "--sleep"))                  { options.sleep = true; }
+        else if (!strcmp(arg, "--csv"))                    { options.csv = true; }
+        else if (!strcmp(arg, "--kernel") && value)
+        {
+            ok = false;
+            for (int32 kernel = 0; kernel < 4; ++kernel)
+            {
+                if (!strcmp(value, kernel_names[kernel]))
+                {
+                    options.kernel = (Bench_Kernel)kernel;
+                    ok = true;
+                }
+            }
+            ++i;
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "invalid argument: %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static Solver_Params make_params(const Bench_Options & options)
+{
+    Solver_Params params;
+    params.dt = BENCH_DT;
+    params.k = BENCH_K;
+    params.damping = BENCH_DAMPING;
+    params.cg_max_iterations = 20;
+    params.cg_tolerance = 1e-3f;
+    params.use_stencil = options.kernel == BenchKernel_Scalar || options.kernel == BenchKernel_SIMD;
+    params.use_springs = options.kernel != BenchKernel_Neighbours;
+    params.isa = options.kernel == BenchKernel_SIMD ? best_simd_isa() : SimdIsa_Scalar;
+    params.verify_stencil = false;
+    params.multithreaded = msd_worker_threads() > 1;
+    params.sleep = options.sleep;
+    params.sleep_threshold = 0.05f;
+    params.collision.thickness = options.collide ? BENCH_GRID_SIZE * 0.25f : 0.0f;
+    params.collision.friction = 0.3f;
+    params.collision.self_collision = options.collide;
+    return params;
+}
+
+static void apply_options_material(Particle_Store & points, const Bench_Options & options)
+{
+    TArray<Material_Paint> paints;
+    if (options.pin_top)
+    {
+        Material_Paint anchors;
+        anchors.side_mask = CubeSide_Top;
+        anchors.pinned = true;
+        paints.Add(anchors);
+    }
+    apply_material(points, BENCH_MASS, paints);
+}
+
+static Lattice_Key make_key(int32 size, int32 shell, float shear, float bend)
+{
+    const float edge = (size - 1) * BENCH_GRID_SIZE;
+    return make_lattice_key(FVector(edge, edge, edge), BENCH_GRID_SIZE, SurfaceMode_SharedFaces, shell, shear, bend);
+}
+
+// knocks a corner, grid point 0 in every lattice, so there is motion to integrate
+static void kick(Particle_Store & points, const Lattice_Stencil & stencil, Integrator & integrator, const Solver_Params & params)
+{
+    Solver_Input input;
+    input.add_impulse(0, FVector(50.0f, 20.0f, 0.0f), points.Num());
+    solver_advance(points, stencil, integrator, params, input, 2);
+}
+
+// runs the kick and BENCH_QUALITY_STEPS steps on a fresh body of the lattice,
+// returns the position of every render vertex
+static void simulate_surface(const Bench_Options & options, const Lattice_Template & lattice, Integrator_Type type, TArray<FVector> & result)
+{
+    Particle_Store points;
+    init_particles(points, lattice.mesh.lattice, BENCH_MASS);
+    apply_options_material(points, options);
+    TUniquePtr<Integrator> integrator = make_integrator(type);
+    const Solver_Params params = make_params(options);
+
+    kick(points, lattice.stencil, *integrator, params);
+    solver_advance(points, lattice.stencil, *integrator, params, Solver_Input(), BENCH_QUALITY_STEPS);
+
+    const TArray<int32> & vertex_point = lattice.mesh.surface.vertex_point;
+    result.SetNumUninitialized(vertex_point.Num());
+    for (int32 v = 0; v < vertex_point.Num(); ++v)
+    {
+        result[v] = points.pos[vertex_point[v]];
+    }
+}
+
+// both lattices emit the same render vertices in the same order
+static double surface_error(const Bench_Options & options, const Lattice_Template & shell, int32 size, Integrator_Type type)
+{
+    Lattice_Template_Ref volume = lattice_cache_acquire(make_key(size, 0, 0.0f, 0.0f));
+    TArray<FVector> shell_surface;
+    TArray<FVector> volume_surface;
+    simulate_surface(options, shell, type, shell_surface);
+    simulate_surface(options, *volume, type, volume_surface);
+
+    double error = 0.0;
+    double displacement = 0.0;
+    for (int32 v = 0; v < volume_surface.Num(); ++v)
+    {
+        error += FVector::DistSquared(shell_surface[v], volume_surface[v]);
+        displacement += FVector::DistSquared(volume_surface[v], volume->mesh.vertices[v]);
+    }
+    return displacement > 0.0 ? std::sqrt(error / displacement) : 0.0;
+}
+
+static Bench_Result run_config(const Bench_Options & options, int32 size, Integrator_Type type)
+{
+    Bench_Result result;
+    Particle_Store points;
+
+    // the previous configuration released its template, so this builds a new one
+    Bench_Clock::time_point generate_begin = Bench_Clock::now();
+    Lattice_Template_Ref lattice = lattice_cache_acquire(make_key(size, options.shell, options.shear, options.bend));
+    init_particles(points, lattice->mesh.lattice, BENCH_MASS);
+    apply_options_material(points, options);
+    result.generate_ms = elapsed_seconds(generate_begin) * 1000.0;
+    result.points = points.Num();
+
+    const Lattice_Stencil & stencil = lattice->stencil;
+    TUniquePtr<Integrator> integrator = make_integrator(type);
+    const Solver_Params params = make_params(options);
+    kick(points, stencil, *integrator, params);
+
+    Solver_Input input;
+    if (options.collide)
+    {
+        // the floor touches the bottom face, so it is in contact from the first step
+        Collision_Plane floor;
+        floor.normal = FVector(0, 0, 1);
+        floor.distance = 0.0f;
+        input.world.planes.Add(floor);
+    }
+
+    Bench_Clock::time_point begin = Bench_Clock::now();
+    result.steps = 0;
+    do
+    {
+        solver_advance(points, stencil, *integrator, params, input, 1);
+        ++result.steps;
+        result.seconds = elapsed_seconds(begin);
+    }
+    while (result.seconds < options.seconds || result.steps < options.min_steps);
+
+    result.bytes = points.allocated_size() + integrator->allocated_size();
+    result.shared_bytes = lattice->allocated_size();
+    result.surface_error = options.shell > 0 ? surface_error(options, *lattice, size, type) : 0.0;
+    return result;
+}
+
+int main(int argc, char ** argv)
+{
+    Bench_Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        print_usage();
+        return 1;
+    }
+
+    const char * isa = options.kernel == BenchKernel_SIMD ? simd_isa_name(best_simd_isa()) : "-";
+    if (options.csv)
+    {
+        printf("size,points,integrator,kernel,isa,threads,steps,steps_per_s,ns_per_point_step,bytes_per_point,shared_bytes_per_point,generate_ms,surface_error\n");
+    }
+    else
+    {
+        printf("%6s %9s %-11s %-10s %-6s %7s %7s %11s %14s %11s %12s %12s %13s\n",
+               "size", "points", "integrator", "kernel", "isa", "threads", "steps", "steps/s", "ns/point/step", "bytes/point", "shared/point", "generate ms", "surface error");
+    }
+
+    for (int32 size : options.sizes)
+    {
+        for (int32 type : options.integrators)
+        {
+            for (int32 threads : options.threads)
+            {
+                msd_set_worker_threads(threads);
+
+                const Bench_Result result = run_config(options, size, (Integrator_Type)type);
+                const double points = result.points;
+                const double steps_per_s = result.steps / result.seconds;
+                const double ns_per_point = result.seconds * 1e9 / (result.steps * points);
+                const double bytes_per_point = result.bytes / points;
+                const double shared_per_point = result.shared_bytes / points;
+
+                printf(options.csv ? "%d,%.0f,%s,%s,%s,%d,%d,%.2f,%.3f,%.1f,%.1f,%.2f,%.4f\n"
+                                   : "%6d %9.0f %-11s %-10s %-6s %7d %7d %11.2f %14.3f %11.1f %12.1f %12.2f %13.4f\n",
+                       size, points, integrator_names[type], kernel_names[options.kernel], isa, threads,
+                       result.steps, steps_per_s, ns_per_point, bytes_per_point, shared_per_point, result.generate_ms,
+                       result.surface_error);
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
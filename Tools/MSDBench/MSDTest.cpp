@@ -0,0 +1,144 @@
+// Checks of the MSD core, built without the engine and run by ctest.
+//
+// Every check prints what went wrong and counts as a failure, the tool returns
+// the number of failed checks so ctest reports any of them.
+
+#include "Scheduler.h"
+#include "Snapshot.h"
+#include "SpatialIndex.h"
+
+#include <cstdio>
+
+static int32 failures = 0;
+
+static void check(bool condition, const char * what, int32 frame, int32 body)
+{
+    if (!condition)
+    {
+        printf("FAILED frame %d body %d: %s\n", frame, body, what);
+        ++failures;
+    }
+}
+
+// The scheduler keeps its scratch across frames, the grants of one frame must
+// not carry over into the next.
+static void check_schedule_frames()
+{
+    Body_Scheduler scheduler;
+    Schedule_Params params;
+    // six and a half steps of 1000 points at the scheduler's initial cost
+    // estimate, the half keeps float rounding away from the sixth step
+    params.budget_ms = (float)(6.5 * 1000 * scheduler.seconds_per_point_step * 1e3);
+
+    TArray<Body_Schedule_Input> inputs;
+    for (int32 i = 0; i < 3; ++i)
+    {
+        Body_Schedule_Input body;
+        body.points = 1000;
+        body.wanted_steps = 4;
+        body.screen_size = 1.0f - i * 0.1f;
+        inputs.Add(body);
+    }
+
+    TArray<Body_Schedule> schedules;
+    TArray<int32> first_steps;
+    for (int32 frame = 0; frame < 2; ++frame)
+    {
+        schedule_bodies(scheduler, params, inputs, schedules);
+
+        int32 total = 0;
+        for (int32 i = 0; i < inputs.Num(); ++i)
+        {
+            check(schedules[i].steps >= 1 && schedules[i].steps <= inputs[i].wanted_steps, "steps outside 1 and the wanted steps", frame, i);
+            check(!schedules[i].starved, "starved while the budget fits a step of every body", frame, i);
+            total += schedules[i].steps;
+            if (frame == 0)
+            {
+                first_steps.Add(schedules[i].steps);
+            }
+            else
+            {
+                check(schedules[i].steps == first_steps[i], "other steps than the frame before for the same input", frame, i);
+            }
+        }
+        check(total == 6, "the steps do not add up to the budget", frame, INDEX_NONE);
+    }
+}
+
+// Clients drop keyframes not newer than their last one, so a server that
+// resets its keyframe state for a restored or regenerated body keeps counting.
+static void check_keyframe_sequence()
+{
+    TArray<FVector> rest;
+    TArray<FVector> positions;
+    for (int32 i = 0; i < 8; ++i)
+    {
+        rest.Add(FVector((float)i, 0.0f, 0.0f));
+        positions.Add(FVector((float)i, 2.0f, 0.0f));
+    }
+
+    Keyframe_State state;
+    Keyframe_Params params;
+    TArray<int32> torn;
+    TArray<uint8> data;
+    TArray<int32> points;
+    TArray<FVector> read_positions;
+    TArray<int32> read_torn;
+    uint32 last = 0;
+    for (int32 frame = 0; frame < 2; ++frame)
+    {
+        state.reset();
+        uint32 sequence = 0;
+        const bool sent = keyframe_write(state, positions, rest, torn, params, data) > 0;
+        check(sent && keyframe_read(data, rest, 0, sequence, points, read_positions, read_torn), "no keyframe after a reset", frame, INDEX_NONE);
+        check(frame == 0 || (int32)(sequence - last) > 0, "the sequence went back after a reset", frame, INDEX_NONE);
+        last = sequence;
+    }
+}
+
+// The nearest point query walks shells of cells, it has to find what a scan of
+// every point finds.
+static void check_spatial_nearest()
+{
+    const float cell_size = 5.0f;
+    TArray<FVector> positions;
+    uint32 seed = 1;
+    auto random = [&]()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int32 i = 0; i < 500; ++i)
+    {
+        positions.Add(FVector(random(), random(), random()) * 100.0f);
+    }
+
+    Spatial_Grid grid;
+    spatial_build(grid, positions, cell_size);
+    for (int32 query = 0; query < 200; ++query)
+    {
+        const FVector center = FVector(random(), random(), random()) * 120.0f - FVector(10.0f, 10.0f, 10.0f);
+        const float max_radius = 2.0f + random() * 30.0f;
+        int32 expected = INDEX_NONE;
+        float expected_sq = max_radius * max_radius;
+        for (int32 idx = 0; idx < positions.Num(); ++idx)
+        {
+            const float dist_sq = FVector::DistSquared(positions[idx], center);
+            if (dist_sq < expected_sq)
+            {
+                expected = idx;
+                expected_sq = dist_sq;
+            }
+        }
+        check(spatial_query_nearest(grid, positions, center, max_radius) == expected, "another nearest point than a scan of all points", query, expected);
+    }
+}
+
+int main()
+{
+    check_schedule_frames();
+    check_keyframe_sequence();
+    check_spatial_nearest();
+    printf("%d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,153 @@
+#include "MSDStandalone.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+const FVector FVector::ZeroVector(0.0f, 0.0f, 0.0f);
+
+// set while a thread runs ParallelFor items, nested loops then run inline
+static thread_local bool in_parallel_for = false;
+
+// Fixed pool of workers that pull item indices of the current ParallelFor
+// from a shared counter, the calling thread takes part as well.
+class Worker_Pool
+{
+public:
+    ~Worker_Pool() { resize(0); }
+
+    int32 num_threads() const { return (int32)workers.size() + 1; }
+
+    void resize(int32 threads)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            ++generation;
+        }
+        wake.notify_all();
+        for (std::thread & worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+
+        // workers start out having seen the current generation, so none of
+        // them runs a job that was dispatched before it existed
+        quit = false;
+        const uint64 current = generation;
+        for (int32 i = 1; i < threads; ++i)
+        {
+            workers.emplace_back([this, current]() { work(current); });
+        }
+    }
+
+    void run(int32 count, TFunctionRef<void(int32)> body)
+    {
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job_body = &body;
+            job_count = count;
+            next_item.store(0);
+            busy_workers = (int32)workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        drain(body, count);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy_workers == 0; });
+        job_body = nullptr;
+    }
+
+private:
+    void drain(TFunctionRef<void(int32)> body, int32 count)
+    {
+        in_parallel_for = true;
+        for (int32 item = next_item.fetch_add(1); item < count; item = next_item.fetch_add(1))
+        {
+            body(item);
+        }
+        in_parallel_for = false;
+    }
+
+    void work(uint64 seen)
+    {
+        for (;;)
+        {
+            TFunctionRef<void(int32)> * body = nullptr;
+            int32 count = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return generation != seen; });
+                seen = generation;
+                if (quit)
+                {
+                    return;
+                }
+                body = job_body;
+                count = job_count;
+            }
+
+            drain(*body, count);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --busy_workers;
+            }
+            done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    TFunctionRef<void(int32)> * job_body = nullptr;
+    int32 job_count = 0;
+    std::atomic<int32> next_item{0};
+    int32 busy_workers = 0;
+    uint64 generation = 0;
+    bool quit = false;
+};
+
+static Worker_Pool & worker_pool()
+{
+    static Worker_Pool pool;
+    static bool started = false;
+    if (!started)
+    {
+        started = true;
+        pool.resize(FMath::Max((int32)std::thread::hardware_concurrency(), 1));
+    }
+    return pool;
+}
+
+void msd_set_worker_threads(int32 count)
+{
+    worker_pool().resize(FMath::Max(count, 1));
+}
+
+int32 msd_worker_threads()
+{
+    return worker_pool().num_threads();
+}
+
+void ParallelFor(int32 Num, TFunctionRef<void(int32)> Body, bool bForceSingleThread)
+{
+    Worker_Pool & pool = worker_pool();
+    if (bForceSingleThread || Num <= 1 || pool.num_threads() == 1 || in_parallel_for)
+    {
+        for (int32 i = 0; i < Num; ++i)
+        {
+            Body(i);
+        }
+        return;
+    }
+    pool.run(Num, Body);
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+// Minimal std based stand-ins for the engine types the MSD core is written
+// against, used when it is built outside the engine (MSD_STANDALONE). Only the
+// subset of each interface the core actually calls is provided, with the same
+// names and semantics as the engine's.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef int8_t   int8;
+typedef uint8_t  uint8;
+typedef int16_t  int16;
+typedef uint16_t uint16;
+typedef int32_t  int32;
+typedef uint32_t uint32;
+typedef int64_t  int64;
+typedef uint64_t uint64;
+typedef size_t   SIZE_T;
+typedef char     TCHAR;
+
+#define TEXT(x) x
+#define INDEX_NONE (-1)
+#define MAX_flt (3.402823466e+38F)
+#define FORCEINLINE inline
+#define UE_LOG(Category, Verbosity, Format, ...) fprintf(stderr, Format "\n", ##__VA_ARGS__)
+
+
+struct FMemory
+{
+    static void * Memcpy(void * dest, const void * src, SIZE_T count) { return memcpy(dest, src, count); }
+    static void * Memzero(void * dest, SIZE_T count) { return memset(dest, 0, count); }
+    static void * Memset(void * dest, uint8 value, SIZE_T count) { return memset(dest, value, count); }
+};
+
+struct FMath
+{
+    template <typename T> static T Min(T a, T b) { return a < b ? a : b; }
+    template <typename T> static T Max(T a, T b) { return a > b ? a : b; }
+    template <typename T> static T Min3(T a, T b, T c) { return Min(Min(a, b), c); }
+    template <typename T> static T Max3(T a, T b, T c) { return Max(Max(a, b), c); }
+    template <typename T> static T Abs(T a) { return a < 0 ? -a : a; }
+    template <typename T> static T Clamp(T a, T lo, T hi) { return a < lo ? lo : (a > hi ? hi : a); }
+    template <typename T> static T Square(T a) { return a * a; }
+
+    static float Sqrt(float a) { return std::sqrt(a); }
+    static bool IsFinite(float a) { return std::isfinite(a); }
+    static int32 FloorToInt(float a) { return (int32)std::floor(a); }
+    static int32 CeilToInt(float a) { return (int32)std::ceil(a); }
+    static int32 RoundToInt(float a) { return FloorToInt(a + 0.5f); }
+    static int32 TruncToInt(float a) { return (int32)a; }
+    static int32 DivideAndRoundUp(int32 dividend, int32 divisor) { return (dividend + divisor - 1) / divisor; }
+
+    static uint32 RoundUpToPowerOfTwo(uint32 a)
+    {
+        uint32 result = 1;
+        while (result < a)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+};
+
+
+struct FVector
+{
+    float X, Y, Z;
+
+    FVector() {}
+    explicit FVector(float v) : X(v), Y(v), Z(v) {}
+    FVector(float x, float y, float z) : X(x), Y(y), Z(z) {}
+
+    static const FVector ZeroVector;
+
+    FVector operator+(const FVector & o) const { return FVector(X + o.X, Y + o.Y, Z + o.Z); }
+    FVector operator-(const FVector & o) const { return FVector(X - o.X, Y - o.Y, Z - o.Z); }
+    FVector operator*(const FVector & o) const { return FVector(X * o.X, Y * o.Y, Z * o.Z); }
+    FVector operator/(const FVector & o) const { return FVector(X / o.X, Y / o.Y, Z / o.Z); }
+    FVector operator+(float s) const { return FVector(X + s, Y + s, Z + s); }
+    FVector operator-(float s) const { return FVector(X - s, Y - s, Z - s); }
+    FVector operator*(float s) const { return FVector(X * s, Y * s, Z * s); }
+    FVector operator/(float s) const { const float inv = 1.0f / s; return FVector(X * inv, Y * inv, Z * inv); }
+    FVector operator-() const { return FVector(-X, -Y, -Z); }
+
+    FVector & operator+=(const FVector & o) { X += o.X; Y += o.Y; Z += o.Z; return *this; }
+    FVector & operator-=(const FVector & o) { X -= o.X; Y -= o.Y; Z -= o.Z; return *this; }
+    FVector & operator*=(const FVector & o) { X *= o.X; Y *= o.Y; Z *= o.Z; return *this; }
+    FVector & operator*=(float s) { X *= s; Y *= s; Z *= s; return *this; }
+
+    bool operator==(const FVector & o) const { return X == o.X && Y == o.Y && Z == o.Z; }
+    bool operator!=(const FVector & o) const { return !(*this == o); }
+
+    float operator[](int32 i) const { return (&X)[i]; }
+    float & operator[](int32 i) { return (&X)[i]; }
+
+    float Size() const { return std::sqrt(SizeSquared()); }
+    float SizeSquared() const { return X * X + Y * Y + Z * Z; }
+    float GetMax() const { return FMath::Max3(X, Y, Z); }
+    float GetMin() const { return FMath::Min(FMath::Min(X, Y), Z); }
+    FVector GetAbs() const { return FVector(std::fabs(X), std::fabs(Y), std::fabs(Z)); }
+    bool IsNearlyZero(float tolerance = 1.e-4f) const { return std::fabs(X) <= tolerance && std::fabs(Y) <= tolerance && std::fabs(Z) <= tolerance; }
+
+    FVector GetSafeNormal(float tolerance = 1.e-8f) const
+    {
+        const float square = SizeSquared();
+        return square > tolerance ? *this * (1.0f / std::sqrt(square)) : FVector(0, 0, 0);
+    }
+
+    FVector ComponentMin(const FVector & o) const { return FVector(FMath::Min(X, o.X), FMath::Min(Y, o.Y), FMath::Min(Z, o.Z)); }
+    FVector ComponentMax(const FVector & o) const { return FVector(FMath::Max(X, o.X), FMath::Max(Y, o.Y), FMath::Max(Z, o.Z)); }
+
+    static float DotProduct(const FVector & a, const FVector & b) { return a.X * b.X + a.Y * b.Y + a.Z * b.Z; }
+    static FVector CrossProduct(const FVector & a, const FVector & b) { return FVector(a.Y * b.Z - a.Z * b.Y, a.Z * b.X - a.X * b.Z, a.X * b.Y - a.Y * b.X); }
+    static float DistSquared(const FVector & a, const FVector & b) { return (a - b).SizeSquared(); }
+    static float Dist(const FVector & a, const FVector & b) { return (a - b).Size(); }
+};
+
+inline FVector operator*(float s, const FVector & v) { return v * s; }
+
+struct FVector2D
+{
+    float X, Y;
+
+    FVector2D() {}
+    FVector2D(float x, float y) : X(x), Y(y) {}
+};
+
+struct FIntVector
+{
+    int32 X, Y, Z;
+
+    FIntVector() {}
+    explicit FIntVector(int32 v) : X(v), Y(v), Z(v) {}
+    FIntVector(int32 x, int32 y, int32 z) : X(x), Y(y), Z(z) {}
+
+    FIntVector operator+(const FIntVector & o) const { return FIntVector(X + o.X, Y + o.Y, Z + o.Z); }
+    FIntVector operator-(const FIntVector & o) const { return FIntVector(X - o.X, Y - o.Y, Z - o.Z); }
+    bool operator==(const FIntVector & o) const { return X == o.X && Y == o.Y && Z == o.Z; }
+    bool operator!=(const FIntVector & o) const { return !(*this == o); }
+
+    int32 operator[](int32 i) const { return (&X)[i]; }
+    int32 & operator[](int32 i) { return (&X)[i]; }
+};
+
+
+template <typename T>
+class TArray
+{
+public:
+    TArray() {}
+    TArray(const T * data, int32 count) : items(data, data + count) {}
+
+    int32 Num() const { return (int32)items.size(); }
+    int32 Max() const { return (int32)items.capacity(); }
+    bool IsValidIndex(int32 i) const { return i >= 0 && i < Num(); }
+    SIZE_T GetAllocatedSize() const { return items.capacity() * sizeof(T); }
+
+    T * GetData() { return items.data(); }
+    const T * GetData() const { return items.data(); }
+    T & operator[](int32 i) { return items[i]; }
+    const T & operator[](int32 i) const { return items[i]; }
+    T & Last() { return items.back(); }
+    const T & Last() const { return items.back(); }
+
+    int32 Add(const T & item) { items.push_back(item); return Num() - 1; }
+    int32 AddUninitialized(int32 count = 1) { const int32 first = Num(); items.resize(first + count); return first; }
+    int32 AddZeroed(int32 count = 1) { const int32 first = AddUninitialized(count); memset((void *)(items.data() + first), 0, count * sizeof(T)); return first; }
+    void Append(const TArray & other) { items.insert(items.end(), other.items.begin(), other.items.end()); }
+    void Append(const T * data, int32 count) { items.insert(items.end(), data, data + count); }
+    void Pop() { items.pop_back(); }
+    void RemoveAt(int32 i, int32 count = 1) { items.erase(items.begin() + i, items.begin() + i + count); }
+    void RemoveAtSwap(int32 i) { items[i] = std::move(items.back()); items.pop_back(); }
+
+    int32 Find(const T & item) const
+    {
+        const auto it = std::find(items.begin(), items.end(), item);
+        return it == items.end() ? INDEX_NONE : (int32)(it - items.begin());
+    }
+    bool Contains(const T & item) const { return Find(item) != INDEX_NONE; }
+
+    // the engine leaves new elements uninitialized, value initialising them here is a superset
+    void SetNum(int32 count) { items.resize(count); }
+    void SetNumUninitialized(int32 count, bool /*allow_shrinking*/ = true) { items.resize(count); }
+    // like the engine only the elements past the old Num() come zeroed, bytes
+    // rather than T() which leaves FVector uninitialized
+    void SetNumZeroed(int32 count) { count > Num() ? (void)AddZeroed(count - Num()) : items.resize(count); }
+    void Init(const T & item, int32 count) { items.assign(count, item); }
+    void Reserve(int32 count) { items.reserve(count); }
+    void Reset(int32 slack = 0) { items.clear(); items.reserve(slack); }
+    void Empty(int32 slack = 0) { std::vector<T>().swap(items); items.reserve(slack); }
+    void Shrink() { items.shrink_to_fit(); }
+
+    void Sort() { std::sort(items.begin(), items.end()); }
+    template <typename Predicate> void Sort(Predicate predicate) { std::sort(items.begin(), items.end(), predicate); }
+
+    typename std::vector<T>::iterator begin() { return items.begin(); }
+    typename std::vector<T>::iterator end() { return items.end(); }
+    typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+    typename std::vector<T>::const_iterator end() const { return items.end(); }
+
+    void swap(TArray & other) { items.swap(other.items); }
+
+private:
+    std::vector<T> items;
+};
+
+template <typename T> void Sort(T * first, int32 count) { std::sort(first, first + count); }
+
+template <typename T> void Swap(T & a, T & b) { std::swap(a, b); }
+template <typename T> void Swap(TArray<T> & a, TArray<T> & b) { a.swap(b); }
+template <typename T> typename std::remove_reference<T>::type && MoveTemp(T && a) { return static_cast<typename std::remove_reference<T>::type &&>(a); }
+
+template <typename T> using TUniquePtr = std::unique_ptr<T>;
+template <typename T, typename... Args> TUniquePtr<T> MakeUnique(Args &&... args) { return TUniquePtr<T>(new T(std::forward<Args>(args)...)); }
+
+// std::shared_ptr is always thread safe, the mode only exists for source compatibility
+enum class ESPMode { NotThreadSafe, ThreadSafe, Fast = NotThreadSafe };
+
+template <typename T, ESPMode Mode = ESPMode::Fast>
+class TSharedPtr
+{
+public:
+    TSharedPtr() {}
+    TSharedPtr(std::nullptr_t) {}
+    template <typename U> TSharedPtr(const TSharedPtr<U, Mode> & other) : ptr(other.ptr) {}
+    explicit TSharedPtr(std::shared_ptr<T> p) : ptr(std::move(p)) {}
+
+    bool IsValid() const { return (bool)ptr; }
+    T * Get() const { return ptr.get(); }
+    void Reset() { ptr.reset(); }
+    int32 GetSharedReferenceCount() const { return (int32)ptr.use_count(); }
+    T * operator->() const { return ptr.get(); }
+    T & operator*() const { return *ptr; }
+    bool operator==(const TSharedPtr & other) const { return ptr == other.ptr; }
+    bool operator!=(const TSharedPtr & other) const { return ptr != other.ptr; }
+
+private:
+    template <typename U, ESPMode M> friend class TSharedPtr;
+    template <typename U, ESPMode M> friend class TWeakPtr;
+    std::shared_ptr<T> ptr;
+};
+
+template <typename T, ESPMode Mode = ESPMode::Fast>
+class TWeakPtr
+{
+public:
+    TWeakPtr() {}
+    template <typename U> TWeakPtr(const TSharedPtr<U, Mode> & other) : ptr(other.ptr) {}
+
+    TSharedPtr<T, Mode> Pin() const { return TSharedPtr<T, Mode>(ptr.lock()); }
+    bool IsValid() const { return !ptr.expired(); }
+
+private:
+    std::weak_ptr<T> ptr;
+};
+
+template <typename T, ESPMode Mode = ESPMode::Fast, typename... Args>
+TSharedPtr<T, Mode> MakeShared(Args &&... args) { return TSharedPtr<T, Mode>(std::make_shared<T>(std::forward<Args>(args)...)); }
+
+
+// Non owning reference to a callable, like the engine's it must not outlive
+// the callable it was created from.
+template <typename Signature> class TFunctionRef;
+
+template <typename Ret, typename... Params>
+class TFunctionRef<Ret(Params...)>
+{
+public:
+    template <typename Functor, typename = typename std::enable_if<!std::is_same<typename std::decay<Functor>::type, TFunctionRef>::value>::type>
+    TFunctionRef(Functor && functor)
+        : callable((void *)&functor)
+        , invoker(&invoke<typename std::remove_reference<Functor>::type>)
+    {
+    }
+
+    Ret operator()(Params... params) const { return invoker(callable, std::forward<Params>(params)...); }
+
+private:
+    template <typename Functor>
+    static Ret invoke(void * callable, Params... params) { return (*(Functor *)callable)(std::forward<Params>(params)...); }
+
+    void * callable;
+    Ret (*invoker)(void *, Params...);
+};
+
+
+// Worker threads ParallelFor spreads its items across. Defaults to the number
+// of hardware threads, a count of 1 runs everything on the calling thread.
+void msd_set_worker_threads(int32 count);
+int32 msd_worker_threads();
+
+void ParallelFor(int32 Num, TFunctionRef<void(int32)> Body, bool bForceSingleThread = false);